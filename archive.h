@@ -0,0 +1,1749 @@
+#pragma once
+
+#include <algorithm>
+#include "inflate.h"
+
+// the portable part of zipmount: the archive index, its sidecar, the decompressed block cache and the
+// decoders; the frontends (dokan on windows, fuse on linux) only translate their callbacks into $archive calls
+
+using namespace std; namespace fs = filesystem; using fs::path;
+
+// in a namespace of its own, so that the library links into programs with a buffer_t or an lru_policy_t of theirs
+namespace zipmount::detail {
+
+// what a cache entry carries for its eviction policy: list hooks, a heap slot and the numbers the policies weigh
+struct cache_entry_t {
+    cache_entry_t * prev {nullptr}, * next {nullptr}; uint64_t hash {0}; size_t bytes {0}, slot {0}; double cost {0}, priority {0}; uint32_t frequency {0}; int segment {0};
+};
+
+// an intrusive list of entries, most recently used first
+struct entry_list_t {
+    cache_entry_t * head {nullptr}, * tail {nullptr}; size_t bytes {0};
+
+    void push_front(cache_entry_t * e) { e->prev = nullptr; e->next = head; (head ? head->prev : tail) = e; head = e; bytes += e->bytes; }
+
+    void remove(cache_entry_t * e) { (e->prev ? e->prev->next : head) = e->next; (e->next ? e->next->prev : tail) = e->prev; bytes -= e->bytes; }
+
+    void touch(cache_entry_t * e) { if(e != head) { remove(e); push_front(e); } }
+};
+
+// decides what a cache keeps: told about every insertion, hit and removal under the cache's lock, and asked for the
+// entry to evict next while the cache is over budget
+struct cache_policy_t {
+    virtual ~cache_policy_t() = default;
+
+    virtual void resize(size_t capacity) {}
+
+    virtual void insert(cache_entry_t * e) = 0;
+
+    virtual void hit(cache_entry_t * e) = 0;
+
+    virtual void remove(cache_entry_t * e) = 0;
+
+    virtual cache_entry_t * victim() = 0;
+};
+
+// least recently used goes first
+struct lru_policy_t : cache_policy_t {
+    entry_list_t list;
+
+    void insert(cache_entry_t * e) override { list.push_front(e); }
+
+    void hit(cache_entry_t * e) override { list.touch(e); }
+
+    void remove(cache_entry_t * e) override { list.remove(e); }
+
+    cache_entry_t * victim() override { return list.tail; }
+};
+
+// greedy dual size frequency: an entry is worth clock + frequency * cost / size, the cheapest goes first and moves
+// the clock up to its worth, so big, cheap to rebuild or long unused entries leave before small, costly or hot ones
+struct gdsf_policy_t : cache_policy_t {
+    std::vector<cache_entry_t *> heap; double clock {0};
+
+    void insert(cache_entry_t * e) override {
+        e->frequency = 1; e->priority = worth(e); e->slot = heap.size(); heap.push_back(e); up(e->slot);
+    }
+
+    void hit(cache_entry_t * e) override {
+        ++e->frequency; e->priority = worth(e); down(e->slot);
+    }
+
+    void remove(cache_entry_t * e) override {
+        auto last = heap.back(); heap.pop_back(); if(e != last) {
+            heap[e->slot] = last; last->slot = e->slot; down(last->slot); up(last->slot);
+        }
+    }
+
+    cache_entry_t * victim() override {
+        if(heap.empty()) return nullptr; clock = heap[0]->priority; return heap[0];
+    }
+
+    double worth(cache_entry_t * e) const { return clock + e->frequency * e->cost / std::max<size_t>(e->bytes, 1); }
+
+    void up(size_t i) {
+        while(i && heap[i]->priority < heap[(i - 1) / 2]->priority) {
+            swap_at(i, (i - 1) / 2); i = (i - 1) / 2;
+        }
+    }
+
+    void down(size_t i) {
+        for(;;) {
+            auto m = i, l = 2 * i + 1, r = l + 1;
+            if(l < heap.size() && heap[l]->priority < heap[m]->priority) m = l;
+            if(r < heap.size() && heap[r]->priority < heap[m]->priority) m = r;
+            if(m == i) return; swap_at(i, m); i = m;
+        }
+    }
+
+    void swap_at(size_t i, size_t j) { std::swap(heap[i], heap[j]); heap[i]->slot = i; heap[j]->slot = j; }
+};
+
+// window tinylfu: new entries start in a small lru window, and leaving it they only get into the main area if a
+// count-min sketch of recent accesses says they are used more often than the main area's next victim, so one pass
+// over a lot of cold data cannot flush the hot set; the main area is a segmented lru of probation and protected
+struct tinylfu_policy_t : cache_policy_t {
+    enum { WINDOW, PROBATION, PROTECTED };
+
+    entry_list_t lists[3]; size_t capacity {0}, window_capacity {0}, protected_capacity {0};
+
+    std::vector<uint8_t> sketch; uint64_t mask {0}; size_t additions {0};
+
+    void resize(size_t bytes) override {
+        capacity = bytes; window_capacity = std::max<size_t>(bytes / 100, 1); protected_capacity = (bytes - window_capacity) * 4 / 5;
+
+        // four rows of counters, about one per 4 KiB of budget, halved every ten times that many accesses
+        auto width = std::bit_ceil(std::max<size_t>(bytes / 4096, 1024)); if(width * 4 != sketch.size()) {
+            sketch.assign(width * 4, 0); mask = width - 1; additions = 0;
+        }
+    }
+
+    void insert(cache_entry_t * e) override {
+        count(e->hash); e->segment = WINDOW; lists[WINDOW].push_front(e);
+    }
+
+    void hit(cache_entry_t * e) override {
+        count(e->hash); if(e->segment != PROBATION) {
+            lists[e->segment].touch(e); return;
+        }
+
+        lists[PROBATION].remove(e); e->segment = PROTECTED; lists[PROTECTED].push_front(e);
+
+        while(lists[PROTECTED].bytes > protected_capacity && lists[PROTECTED].tail != e) {
+            auto d = lists[PROTECTED].tail; lists[PROTECTED].remove(d); d->segment = PROBATION; lists[PROBATION].push_front(d);
+        }
+    }
+
+    void remove(cache_entry_t * e) override { lists[e->segment].remove(e); }
+
+    cache_entry_t * victim() override {
+        auto & window = lists[WINDOW]; auto & probation = lists[PROBATION]; auto & main = lists[PROTECTED];
+
+        while(window.bytes > window_capacity && window.tail) {
+            auto c = window.tail; window.remove(c); c->segment = PROBATION; probation.push_front(c);
+
+            // while the main area has room the window just drains into it
+            if(probation.bytes + main.bytes <= capacity - window_capacity) continue;
+
+            auto v = probation.tail != c ? probation.tail : main.tail; if(!v) return c;
+
+            return frequency(c->hash) > frequency(v->hash) ? v : c;
+        }
+
+        return probation.tail ? probation.tail : main.tail ? main.tail : window.tail;
+    }
+
+    uint8_t & counter(uint64_t h, int row) {
+        auto x = (h + row * 0x9E3779B97F4A7C15ull) * 0xff51afd7ed558ccdull; return sketch[row * (mask + 1) + ((x >> 32) & mask)];
+    }
+
+    uint32_t frequency(uint64_t h) {
+        uint32_t r = 15; for(int row = 0; row < 4; ++row) r = std::min<uint32_t>(r, counter(h, row)); return r;
+    }
+
+    void count(uint64_t h) {
+        for(int row = 0; row < 4; ++row) {
+            auto & c = counter(h, row); if(c < 15) ++c;
+        }
+
+        if(++additions >= (mask + 1) * 10) {
+            for(auto & c : sketch) c >>= 1; additions /= 2;
+        }
+    }
+};
+
+static std::unique_ptr<cache_policy_t> make_policy(std::string_view name) {
+    if(name == "lru") return std::make_unique<lru_policy_t>();
+    if(name == "gdsf") return std::make_unique<gdsf_policy_t>();
+    if(name == "tinylfu") return std::make_unique<tinylfu_policy_t>();
+
+    return nullptr;
+}
+
+// a cache which evicts items by its policy once the total size of its values exceeds its capacity in bytes; items
+// sit on an intrusive hash chain and lookups hand out pinned, reference counted handles so a hit moves no data and
+// an evicted value stays alive until its last reader drops it; all members are safe to call from several threads
+template<class Key, class Value, class Hash = std::hash<Key>>
+class policy_cache {
+    struct node_type : cache_entry_t {
+        Key key; Value value; node_type * chain {nullptr}; std::atomic<uint32_t> refs {1};
+    };
+
+    static void release(node_type * n) { if(n->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete n; }
+
+public:
+    typedef Key key_type;
+    typedef Value value_type;
+
+    // a pinned value, empty if the lookup missed
+    class handle {
+    public:
+        handle() = default;
+        handle(handle const & h) : m_node(h.m_node) { if(m_node) m_node->refs.fetch_add(1, std::memory_order_relaxed); }
+        handle(handle && h) noexcept : m_node(std::exchange(h.m_node, nullptr)) {}
+        handle & operator=(handle h) noexcept { std::swap(m_node, h.m_node); return *this; }
+        ~handle() { if(m_node) release(m_node); }
+
+        explicit operator bool() const { return m_node != nullptr; }
+
+        const value_type & operator*() const { return m_node->value; }
+        const value_type * operator->() const { return &m_node->value; }
+
+    private:
+        friend class policy_cache; explicit handle(node_type * n) : m_node(n) { m_node->refs.fetch_add(1, std::memory_order_relaxed); }
+
+        node_type * m_node {nullptr};
+    };
+
+    policy_cache(size_t capacity) : m_buckets(16), m_policy(std::make_unique<lru_policy_t>()), m_capacity(capacity) { m_policy->resize(capacity); }
+
+    policy_cache(policy_cache const &) = delete; policy_cache & operator=(policy_cache const &) = delete;
+
+    ~policy_cache() { clear(); }
+
+    size_t size() const { std::lock_guard<std::mutex> lock(m_mutex); return m_count; }
+
+    size_t capacity() const { return m_capacity; }
+
+    size_t bytes() const { std::lock_guard<std::mutex> lock(m_mutex); return m_bytes; }
+
+    void set_capacity(size_t capacity) {
+        std::lock_guard<std::mutex> lock(m_mutex); m_capacity = capacity; m_policy->resize(capacity); trim();
+    }
+
+    // hands the current items over to a new policy
+    void set_policy(std::unique_ptr<cache_policy_t> policy) {
+        std::lock_guard<std::mutex> lock(m_mutex); m_policy = std::move(policy); m_policy->resize(m_capacity);
+
+        for(auto b : m_buckets) for(auto n = b; n; n = n->chain) m_policy->insert(n);
+    }
+
+    bool empty() const { std::lock_guard<std::mutex> lock(m_mutex); return !m_count; }
+
+    bool contains(const key_type & key) { std::lock_guard<std::mutex> lock(m_mutex); return *find(key) != nullptr; }
+
+    // inserts the value unless the key is already cached and returns the cached value, which the policy may have
+    // evicted again right away; cost is what rebuilding the value would take, in bytes decoded, 0 for its size
+    template<typename K, typename V>
+    handle insert(K && key, V && value, double cost = 0) {
+        std::lock_guard<std::mutex> lock(m_mutex); auto slot = find(key); if(*slot) return handle {*slot};
+
+        auto n = new node_type {{}, std::forward<K>(key), std::forward<V>(value)}; {
+            n->hash = hash_of(n->key); n->bytes = n->value.size(); n->cost = cost ? cost : (double)n->bytes;
+
+            *slot = n; m_bytes += n->bytes; ++m_count; m_policy->insert(n);
+        }
+
+        handle r {n}; trim(); if(m_count > m_buckets.size()) rehash(m_buckets.size() * 2);
+
+        return r;
+    }
+
+    handle get(const key_type & key) {
+        std::lock_guard<std::mutex> lock(m_mutex); auto n = *find(key); if(!n) return {};
+
+        m_policy->hit(n); return handle {n};
+    }
+
+    // pins a cached value without telling the policy, for a caller holding on to what a get() it made already counted
+    handle peek(const key_type & key) {
+        std::lock_guard<std::mutex> lock(m_mutex); auto n = *find(key); return n ? handle {n} : handle {};
+    }
+
+    void erase(const key_type & key) {
+        std::lock_guard<std::mutex> lock(m_mutex); auto slot = find(key); if(auto n = *slot) {
+            *slot = n->chain; drop(n);
+        }
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(m_mutex); for(auto & b : m_buckets) {
+            while(auto n = b) {
+                b = n->chain; m_policy->remove(n); release(n);
+            }
+        }
+
+        m_count = m_bytes = 0;
+    }
+
+private:
+    static uint64_t hash_of(const key_type & key) {
+        // keys like (entry, block) differ in few bits, mix them before masking
+        uint64_t h = Hash {}(key); h ^= h >> 33; h *= 0xff51afd7ed558ccdull; h ^= h >> 33; return h;
+    }
+
+    node_type ** find(const key_type & key) {
+        auto p = &m_buckets[hash_of(key) & (m_buckets.size() - 1)]; while(*p && !((*p)->key == key)) p = &(*p)->chain; return p;
+    }
+
+    void rehash(size_t buckets) {
+        std::vector<node_type *> old(buckets, nullptr); std::swap(old, m_buckets); for(auto b : old) {
+            while(auto n = b) {
+                b = n->chain; auto & head = m_buckets[n->hash & (buckets - 1)]; n->chain = head; head = n;
+            }
+        }
+    }
+
+    void drop(node_type * n) {
+        m_policy->remove(n); m_bytes -= n->bytes; --m_count; release(n);
+    }
+
+    // evicts what the policy picks while over budget
+    void trim() {
+        while(m_bytes > m_capacity) {
+            auto n = static_cast<node_type *>(m_policy->victim()); if(!n) break;
+
+            *find(n->key) = n->chain; drop(n);
+        }
+    }
+
+private:
+    mutable std::mutex m_mutex; std::vector<node_type *> m_buckets; std::unique_ptr<cache_policy_t> m_policy; size_t m_count {0}, m_bytes {0}; std::atomic<size_t> m_capacity;
+};
+
+
+// paths match regardless of (ascii) case where the file system around them does, in the windows frontend, and
+// exactly in the fuse one and the library, so that "Makefile" and "makefile" stay two files there
+#if defined(_WIN32) && !defined(ZIPMOUNT_LIBRARY)
+static constexpr bool FOLD_CASE = true;
+#else
+static constexpr bool FOLD_CASE = false;
+#endif
+
+// folds like miniz's MZ_TOLOWER when paths match regardless of case, leaves the character alone otherwise
+static inline char fold_case(char c) { return (FOLD_CASE && c >= 'A' && c <= 'Z') ? (c + ('a' - 'A')) : c; }
+
+static int path_compare(string_view a, string_view b) {
+    auto n = std::min(a.size(), b.size()); for(size_t i = 0; i < n; ++i) {
+        auto x = fold_case(a[i]), y = fold_case(b[i]); if(x != y) return (unsigned char)x < (unsigned char)y ? -1 : 1;
+    }
+
+    return (a.size() == b.size()) ? 0 : (a.size() < b.size() ? -1 : 1);
+}
+
+struct path_hash {
+    size_t operator()(string_view s) const {
+        uint64_t h = 14695981039346656037ull; for(auto c : s) { h ^= (unsigned char)fold_case(c); h *= 1099511628211ull; } return h;
+    }
+};
+
+struct path_equal {
+    bool operator()(string_view a, string_view b) const { return path_compare(a, b) == 0; }
+};
+
+// zip record layout (see APPNOTE.TXT), only the fields the index reads
+enum {
+    ZIP_CDH_SIZE = 46, ZIP_CDH_BIT_FLAG_OFS = 8, ZIP_CDH_METHOD_OFS = 10, ZIP_CDH_FILE_TIME_OFS = 12, ZIP_CDH_FILE_DATE_OFS = 14,
+    ZIP_CDH_CRC32_OFS = 16, ZIP_CDH_COMPRESSED_SIZE_OFS = 20, ZIP_CDH_DECOMPRESSED_SIZE_OFS = 24, ZIP_CDH_FILENAME_LEN_OFS = 28,
+    ZIP_CDH_EXTRA_LEN_OFS = 30, ZIP_CDH_COMMENT_LEN_OFS = 32, ZIP_CDH_EXTERNAL_ATTR_OFS = 38, ZIP_CDH_LOCAL_HEADER_OFS = 42,
+    ZIP64_EXTRA_ID = 0x0001, ZIP_DOS_DIR_ATTRIBUTE = 0x10, ZIP_CDH_SIG = 0x02014b50, ZIP_LDH_SIZE = 30,
+
+    ZIP_EOCD_SIZE = 22, ZIP_EOCD_SIG = 0x06054b50, ZIP_EOCD_TOTAL_ENTRIES_OFS = 10, ZIP_EOCD_CDIR_SIZE_OFS = 12, ZIP_EOCD_CDIR_OFS_OFS = 16,
+    ZIP64_EOCDL_SIZE = 20, ZIP64_EOCDL_SIG = 0x07064b50, ZIP64_EOCDL_EOCD_OFS_OFS = 8,
+    ZIP64_EOCD_SIZE = 56, ZIP64_EOCD_SIG = 0x06064b50, ZIP64_EOCD_TOTAL_ENTRIES_OFS = 32, ZIP64_EOCD_CDIR_SIZE_OFS = 40, ZIP64_EOCD_CDIR_OFS_OFS = 48,
+};
+
+// locates the central directory through the (zip64) end of central directory record
+static bool find_central_dir(const uint8_t * data, size_t size, uint64_t & cdir_ofs, uint64_t & cdir_size, uint64_t & num_files) {
+    if(size < ZIP_EOCD_SIZE) return false;
+
+    // the record is followed by a comment of up to 64k
+    auto first = data + size - std::min<size_t>(size, ZIP_EOCD_SIZE + 0xFFFF), p = data + size - ZIP_EOCD_SIZE; while(p > first && MZ_READ_LE32(p) != ZIP_EOCD_SIG) --p;
+
+    if(MZ_READ_LE32(p) != ZIP_EOCD_SIG) return false;
+
+    num_files = MZ_READ_LE16(p + ZIP_EOCD_TOTAL_ENTRIES_OFS); cdir_size = MZ_READ_LE32(p + ZIP_EOCD_CDIR_SIZE_OFS); cdir_ofs = MZ_READ_LE32(p + ZIP_EOCD_CDIR_OFS_OFS);
+
+    if(p - data >= ZIP64_EOCDL_SIZE && MZ_READ_LE32(p - ZIP64_EOCDL_SIZE) == ZIP64_EOCDL_SIG) {
+        auto ofs = MZ_READ_LE64(p - ZIP64_EOCDL_SIZE + ZIP64_EOCDL_EOCD_OFS_OFS); if(size < ZIP64_EOCD_SIZE || ofs > size - ZIP64_EOCD_SIZE || MZ_READ_LE32(data + ofs) != ZIP64_EOCD_SIG) return false;
+
+        auto q = data + ofs; {
+            num_files = MZ_READ_LE64(q + ZIP64_EOCD_TOTAL_ENTRIES_OFS); cdir_size = MZ_READ_LE64(q + ZIP64_EOCD_CDIR_SIZE_OFS); cdir_ofs = MZ_READ_LE64(q + ZIP64_EOCD_CDIR_OFS_OFS);
+        }
+    }
+
+    return cdir_ofs <= size && cdir_size <= size - cdir_ofs && num_files <= cdir_size / ZIP_CDH_SIZE && num_files < INT32_MAX;
+}
+
+// runs f(begin, end) over [0, n) split into one contiguous chunk per thread, not at all if n is 0
+template<typename F>
+static void parallel_for(size_t n, size_t threads, F && f) {
+    if(!n) return;
+
+    auto chunk = (n + threads - 1) / std::max<size_t>(threads, 1); if(threads <= 1 || n <= chunk) {
+        f(size_t {0}, n); return;
+    }
+
+    vector<thread> workers; for(size_t begin = 0; begin < n; begin += chunk) {
+        workers.emplace_back([&f, begin, end = std::min(n, begin + chunk)] { f(begin, end); });
+    }
+
+    for(auto & t : workers) t.join();
+}
+
+// up to a fixed number of threads running tasks queued from anywhere, each started when a task finds no idle one; a
+// task that finds the queue full is refused and the caller does without it, and queued tasks still run before the
+// threads are joined
+class workers_t {
+public:
+    workers_t(size_t threads, size_t limit) : m_threads(std::max<size_t>(threads, 1)), m_limit(limit) {}
+
+    workers_t(workers_t const &) = delete; workers_t & operator=(workers_t const &) = delete;
+
+    ~workers_t() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex); m_stop = true;
+        }
+
+        m_cv.notify_all(); for(auto & t : m_workers) t.join();
+    }
+
+    bool submit(std::move_only_function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex); if(m_tasks.size() >= m_limit) return false;
+
+            m_tasks.push_back(std::move(task)); if(!m_idle && m_workers.size() < m_threads) m_workers.emplace_back([this] { run(); });
+        }
+
+        m_cv.notify_one(); return true;
+    }
+
+private:
+    void run() {
+        for(;;) {
+            std::move_only_function<void()> task; {
+                std::unique_lock<std::mutex> lock(m_mutex); ++m_idle; m_cv.wait(lock, [&] { return m_stop || !m_tasks.empty(); }); --m_idle;
+
+                if(m_tasks.empty()) return; task = std::move(m_tasks.front()); m_tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+
+    std::mutex m_mutex; std::condition_variable m_cv; std::deque<std::move_only_function<void()>> m_tasks; vector<thread> m_workers;
+    size_t m_threads, m_limit, m_idle {0}; bool m_stop {false};
+};
+
+// orders full paths like a pre-order walk of the tree: folding case as lookups do, with '/' below every other
+// character so that a directory's subtree sorts before any sibling that extends its name
+static bool tree_less(string_view a, string_view b) {
+    auto n = std::min(a.size(), b.size()); for(size_t i = 0; i < n; ++i) {
+        auto x = (unsigned char)fold_case(a[i]), y = (unsigned char)fold_case(b[i]); if(x != y) {
+            return (x == '/' ? 0 : x) < (y == '/' ? 0 : y);
+        }
+    }
+
+    return a.size() < b.size();
+}
+
+// normalizes a zip entry name into "a/b/c" form: backslashes become slashes, empty and "."
+// components are dropped and ".." pops a component; returns true if the name denotes a directory
+static bool normalize(string_view name, string & r) {
+    r.clear(); size_t i = 0; while(i < name.size()) {
+        auto j = name.find_first_of("/\\", i); if(j == string_view::npos) j = name.size();
+
+        auto part = name.substr(i, j - i); i = j + 1; {
+            if(part.empty() || part == ".") continue;
+
+            if(part == "..") {
+                auto pos = r.rfind('/'); r.resize(pos == string::npos ? 0 : pos); continue;
+            }
+        }
+
+        if(!r.empty()) r += '/'; r += part;
+    }
+
+    return !name.empty() && (name.back() == '/' || name.back() == '\\');
+}
+
+// recycles the memory behind decompressed buffers: sizes past SMALL are page-aligned virtual memory rounded up to a
+// power of two (large pages from 2 MiB, locked ones on windows when the process may use them and transparent ones
+// elsewhere) and released ones are parked on a free list per size, up to a limit, so eviction and refill reuse the
+// same pages instead of going back to the os
+static struct {
+    enum : size_t { SMALL = 64 << 10, LARGE_PAGE = 2 << 20, CLASSES = 48 };
+
+    std::mutex mutex; vector<void *> pool[CLASSES]; size_t parked {0}, limit {64 << 20}; atomic<bool> large_pages {true};
+
+    static int class_of(size_t size) { return (int)std::bit_width(size - 1); }
+
+    void * take(int c) {
+        {
+            std::lock_guard<std::mutex> lock(mutex); if(!pool[c].empty()) {
+                auto p = pool[c].back(); pool[c].pop_back(); parked -= (size_t)1 << c; return p;
+            }
+        }
+
+        auto size = (size_t)1 << c;
+#ifdef _WIN32
+        if(size >= LARGE_PAGE && large_pages) {
+            if(auto p = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE)) return p; large_pages = false;
+        }
+
+        return VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+        // transparent huge pages rather than MAP_HUGETLB, which only draws on a pool the administrator reserved: the
+        // region is mapped with room to start on a 2 MiB boundary, trimmed to it and marked for khugepaged
+        if(size >= LARGE_PAGE && large_pages) {
+            auto m = mmap(nullptr, size + LARGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0); if(m == MAP_FAILED) return nullptr;
+
+            auto p = (uint8_t *)(((uintptr_t)m + LARGE_PAGE - 1) & ~(uintptr_t)(LARGE_PAGE - 1)), end = (uint8_t *)m + size + LARGE_PAGE; {
+                if(p != m) munmap(m, p - (uint8_t *)m); if(end != p + size) munmap(p + size, end - (p + size));
+            }
+
+#ifdef MADV_HUGEPAGE
+            if(madvise(p, size, MADV_HUGEPAGE)) large_pages = false;
+#endif
+
+            return p;
+        }
+
+        auto p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0); return p != MAP_FAILED ? p : nullptr;
+#endif
+    }
+
+    void give(void * p, int c) {
+        {
+            std::lock_guard<std::mutex> lock(mutex); if(parked + ((size_t)1 << c) <= limit) {
+                pool[c].push_back(p); parked += (size_t)1 << c; return;
+            }
+        }
+
+#ifdef _WIN32
+        VirtualFree(p, 0, MEM_RELEASE);
+#else
+        munmap(p, (size_t)1 << c);
+#endif
+    }
+} buffers;
+
+// an uninitialized, move-only byte buffer; small ones come from mimalloc, the rest from the pool above
+class buffer_t {
+public:
+    buffer_t() = default;
+
+    explicit buffer_t(size_t size) : m_size(size) {
+        if(size <= buffers.SMALL) m_data = (uint8_t *)mi_malloc(size ? size : 1); else m_data = (uint8_t *)buffers.take(m_class = buffers.class_of(size));
+
+        if(!m_data) throw std::bad_alloc();
+    }
+
+    buffer_t(buffer_t && b) noexcept : m_data(std::exchange(b.m_data, nullptr)), m_size(std::exchange(b.m_size, 0)), m_class(b.m_class) {}
+
+    buffer_t & operator=(buffer_t && b) noexcept { std::swap(m_data, b.m_data); std::swap(m_size, b.m_size); std::swap(m_class, b.m_class); return *this; }
+
+    ~buffer_t() {
+        if(!m_data) return; if(m_class < 0) mi_free(m_data); else buffers.give(m_data, m_class);
+    }
+
+    uint8_t * data() { return m_data; }
+
+    const uint8_t * data() const { return m_data; }
+
+    size_t size() const { return m_size; }
+
+private:
+    uint8_t * m_data {nullptr}; size_t m_size {0}; int m_class {-1};
+};
+
+// a raw deflate stream decoded through a 32k ring buffer as tinfl needs it, the input is the
+// whole compressed entry; read() is sequential and keeps a running crc of what it produced unless
+// told the entry was verified already.
+// save() snapshots the decoder, its window and the running crc so that restore() can resume at
+// the same output offset later, the zran access point idea with tinfl's resumable state
+struct inflate_stream_t {
+    struct state_t {
+        tinfl_decompressor inflator; uint64_t in_ofs, out_ofs; size_t out_avail; tinfl_status status; uint32_t crc;
+    };
+
+    tinfl_decompressor inflator; const uint8_t * in {nullptr}; size_t in_size {0}, out_avail {0}; uint64_t out_ofs {0};
+    tinfl_status status {TINFL_STATUS_NEEDS_MORE_INPUT}; uint32_t crc {MZ_CRC32_INIT}; bool check {true}; unique_ptr<uint8_t[]> dict {new uint8_t[TINFL_LZ_DICT_SIZE]};
+
+    void init(const uint8_t * src, size_t size, bool verify = true) {
+        tinfl_init(&inflator); in = src; in_size = size; out_avail = 0; out_ofs = 0; status = TINFL_STATUS_NEEDS_MORE_INPUT; crc = MZ_CRC32_INIT; check = verify;
+    }
+
+    // decodes up to n bytes into dst, fewer only at the end of the stream or on corrupt data
+    size_t read(uint8_t * dst, size_t n) {
+        size_t r = 0; while(r < n) {
+            auto cur = dict.get() + (out_ofs & (TINFL_LZ_DICT_SIZE - 1)); if(!out_avail) {
+                if(status != TINFL_STATUS_NEEDS_MORE_INPUT && status != TINFL_STATUS_HAS_MORE_OUTPUT) break;
+
+                size_t in_bytes = in_size, out_bytes = TINFL_LZ_DICT_SIZE - (out_ofs & (TINFL_LZ_DICT_SIZE - 1));
+                status = tinfl_decompress(&inflator, in, &in_bytes, dict.get(), cur, &out_bytes, 0);
+                in += in_bytes; in_size -= in_bytes; out_avail = out_bytes;
+
+                if(!out_bytes && status == TINFL_STATUS_NEEDS_MORE_INPUT) status = TINFL_STATUS_FAILED; continue;
+            }
+
+            auto c = std::min(n - r, out_avail); memcpy(dst + r, cur, c); if(check) crc = (uint32_t)mz_crc32(crc, cur, c);
+            out_ofs += c; out_avail -= c; r += c;
+        }
+
+        return r;
+    }
+
+    // true if the stream ends right here, tinfl may only see the end of the last block on the next call
+    bool done() {
+        uint8_t b; return read(&b, 1) == 0 && status == TINFL_STATUS_DONE;
+    }
+
+    buffer_t save(const uint8_t * src) const {
+        state_t st {inflator, (uint64_t)(in - src), out_ofs, out_avail, status, crc};
+
+        buffer_t r(sizeof(st) + TINFL_LZ_DICT_SIZE); {
+            memcpy(r.data(), &st, sizeof(st)); memcpy(r.data() + sizeof(st), dict.get(), TINFL_LZ_DICT_SIZE);
+        }
+
+        return r;
+    }
+
+    // src and size describe the same compressed entry the snapshot was taken from
+    void restore(const uint8_t * src, size_t size, buffer_t const & r) {
+        state_t st; memcpy(&st, r.data(), sizeof(st)); memcpy(dict.get(), r.data() + sizeof(st), TINFL_LZ_DICT_SIZE);
+
+        inflator = st.inflator; in = src + st.in_ofs; in_size = size - st.in_ofs; out_ofs = st.out_ofs; out_avail = st.out_avail; status = st.status; crc = st.crc;
+    }
+};
+
+// one-shot decoders for runs whose input and output are both entirely in memory; the streaming path always uses tinfl
+struct codec_t {
+    const char * name; bool (*inflate)(const uint8_t * src, size_t src_size, uint8_t * dst, size_t dst_size);
+};
+
+static const codec_t codecs[] {
+    {"fast", inflate_fast},
+    {"miniz", [](const uint8_t * src, size_t src_size, uint8_t * dst, size_t dst_size) {
+        return tinfl_decompress_mem_to_mem(dst, dst_size, src, src_size, 0) == dst_size;
+    }},
+};
+
+// shards: estimates the miss ratio curve of a stream of keys from a spatially hashed sample of them, a key is
+// followed if its hash is below the threshold, so every access to it is seen and its reuse distance (the bytes of
+// distinct sampled keys used since, scaled up by the sampling rate) is exact; at most MAX_SAMPLES keys are
+// followed, lowering the threshold to drop the highest hash as needed, and the histogram of distances decays so
+// the curve follows a changing workload
+struct mrc_t {
+    enum : uint64_t { MAX_SAMPLES = 2048, BUCKETS = 256, DECAY = 1 << 16 };
+
+    struct sample_t { uint64_t hash, bytes; };
+
+    std::mutex mutex; std::list<sample_t> stack; std::map<uint64_t, std::list<sample_t>::iterator> samples;
+
+    std::atomic<uint64_t> threshold {~0ull}; uint64_t max_bytes, seen {0}; vector<double> histogram; double total {0};
+
+    mrc_t(uint64_t max_bytes) : max_bytes(std::max<uint64_t>(max_bytes, BUCKETS)), histogram(BUCKETS + 1) {}
+
+    static uint64_t hash_of(uint64_t key) {
+        key ^= key >> 33; key *= 0xff51afd7ed558ccdull; key ^= key >> 33; key *= 0xc4ceb9fe1a85ec53ull; return key ^ key >> 33;
+    }
+
+    double rate() const { return std::ldexp((double)threshold.load(std::memory_order_relaxed), -64); }
+
+    void access(uint64_t key, uint64_t bytes) {
+        auto h = hash_of(key); if(h > threshold.load(std::memory_order_relaxed)) return;
+
+        std::lock_guard<std::mutex> lock(mutex); if(h > threshold) return;
+
+        // a first access is a miss at any size and counts in the last bucket
+        size_t bucket = BUCKETS; if(auto i = samples.find(h); i != samples.end()) {
+            uint64_t distance = 0; for(auto & s : stack) {
+                distance += s.bytes; if(&s == &*i->second) break;
+            }
+
+            bucket = std::min<uint64_t>(BUCKETS, (uint64_t)(distance / rate()) * BUCKETS / max_bytes); stack.splice(stack.begin(), stack, i->second);
+        }
+        else {
+            stack.push_front({h, bytes}); samples.emplace(h, stack.begin());
+        }
+
+        histogram[bucket] += 1; total += 1;
+
+        while(samples.size() > MAX_SAMPLES) {
+            auto last = std::prev(samples.end()); auto before = rate(); stack.erase(last->second); samples.erase(last);
+
+            // the counts so far were taken at the higher rate
+            threshold = samples.rbegin()->first; auto scale = rate() / before; for(auto & c : histogram) c *= scale; total *= scale;
+        }
+
+        if(++seen % DECAY == 0) {
+            for(auto & c : histogram) c /= 2; total /= 2;
+        }
+    }
+
+    // the expected miss ratio of a cache of the given size, 1 without any samples yet
+    double miss_ratio(uint64_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex); if(!total) return 1;
+
+        double hits = 0; for(uint64_t b = 0; b < BUCKETS && (b + 1) * max_bytes / BUCKETS <= bytes; ++b) hits += histogram[b];
+
+        return 1 - hits / total;
+    }
+
+    // the curve at every bucket boundary
+    vector<pair<uint64_t, double>> curve() {
+        vector<pair<uint64_t, double>> r; for(uint64_t b = 1; b <= BUCKETS; ++b) r.emplace_back(b * max_bytes / BUCKETS, miss_ratio(b * max_bytes / BUCKETS)); return r;
+    }
+
+    uint64_t samples_seen() { std::lock_guard<std::mutex> lock(mutex); return seen; }
+};
+
+// on-disk layout of <archive>.zmidx: this header, then the index arrays in visit() order, each
+// at an 8-byte aligned offset; the archive size, mtime and a checksum of its end of central
+// directory tell whether the sidecar still matches the archive
+struct sidecar_t {
+    enum { VERSION = 2, SECTIONS = 11 };
+
+    static constexpr char MAGIC[8] = {'Z', 'M', 'I', 'D', 'X', 0, 0, 0};
+
+    char magic[8]; uint32_t version; uint32_t sections; uint64_t archive_size; int64_t archive_mtime; uint32_t eocd_crc; uint32_t num_files;
+
+    // an index built by a frontend that folds case cannot serve one that does not, and the other way around
+    uint32_t fold_case; uint32_t reserved;
+
+    struct { uint64_t offset, count; } section[SECTIONS];
+};
+
+// a whole file mapped read-only, through a file mapping object on windows and mmap() elsewhere
+class mapping_t {
+public:
+    mapping_t() = default;
+
+    mapping_t(mapping_t const &) = delete; mapping_t & operator=(mapping_t const &) = delete;
+
+    ~mapping_t() { unmap(); }
+
+    bool map(string const & fname) {
+        unmap();
+#ifdef _WIN32
+        ATL::CAtlFile f; if(FAILED(f.Create(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL))) return false;
+
+        if(FAILED(m_mapping.MapFile(f))) return false;
+
+        m_data = (const uint8_t *)m_mapping.GetData(); m_size = m_mapping.GetMappingSize(); return true;
+#else
+        auto fd = ::open(fname.c_str(), O_RDONLY | O_CLOEXEC); if(fd < 0) return false;
+
+        struct stat st; if(fstat(fd, &st) || !st.st_size) {
+            close(fd); return false;
+        }
+
+        auto p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0); if(p == MAP_FAILED) {
+            close(fd); return false;
+        }
+
+        m_fd = fd; m_data = (const uint8_t *)p; m_size = (size_t)st.st_size; return true;
+#endif
+    }
+
+    void unmap() {
+#ifdef _WIN32
+        m_mapping.Unmap();
+#else
+        if(m_data) munmap((void *)m_data, m_size); if(m_fd >= 0) close(m_fd); m_fd = -1;
+#endif
+        m_data = nullptr; m_size = 0;
+    }
+
+    const uint8_t * data() const { return m_data; }
+
+    size_t size() const { return m_size; }
+
+#ifndef _WIN32
+    // the file stays open with the mapping, for readers that would rather have the kernel move its pages
+    int fd() const { return m_fd; }
+#endif
+
+private:
+#ifdef _WIN32
+    ATL::CAtlFileMappingBase m_mapping;
+#else
+    int m_fd {-1};
+#endif
+    const uint8_t * m_data {nullptr}; size_t m_size {0};
+};
+
+// an open archive; the index never changes once open() returns, so it may be read from any number of threads
+struct archive_t {
+    enum { NONE, FILE, DIR };
+
+    struct entry_t {
+        int type {0}; int index {0};
+
+        operator bool() const { return !type; }
+
+        bool is_file() const { return type == FILE; }
+
+        bool is_dir() const { return type == DIR; }
+    };
+
+    struct stat_t {
+        string_view fpath; string_view fname; size_t size; int64_t mtime; int type;
+
+        bool is_file() const { return type == FILE; }
+
+        bool is_dir() const { return type == DIR; }
+    };
+
+    // a node of the directory tree, node 0 is the root; paths live NUL-terminated in names,
+    // the children of a dir are the name-sorted range [first_child, first_child + child_count) of children
+    struct node_t {
+        uint32_t fpath {0}; uint32_t fpath_size {0}; uint32_t fname {0}; uint32_t parent {0};
+        uint32_t first_child {0}; uint32_t child_count {0}; int index {-1}; int type {NONE};
+    };
+
+    template<typename T> using array = vector<T>;
+    template<typename T> using view = span<const T>;
+
+    // the index of an archive as plain arrays, owned while it is built and viewed in place
+    // afterwards, which is what lets it be used straight from a memory-mapped sidecar file
+    template<template<typename> class A>
+    struct index_t {
+        // per-node metadata as parallel arrays, so the callbacks read plain integers;
+        // synthesized directories keep all-zero rows
+        struct meta_t {
+            A<uint64_t> size, comp_size, offset; A<int64_t> mtime; A<uint32_t> crc; A<uint16_t> method, flags;
+
+            void resize(size_t n) {
+                size.resize(n); comp_size.resize(n); offset.resize(n); mtime.resize(n); crc.resize(n); method.resize(n); flags.resize(n);
+            }
+
+            void assign(size_t i, meta_t const & from, size_t j) {
+                size[i] = from.size[j]; comp_size[i] = from.comp_size[j]; offset[i] = from.offset[j]; mtime[i] = from.mtime[j];
+                crc[i] = from.crc[j]; method[i] = from.method[j]; flags[i] = from.flags[j];
+            }
+        };
+
+        A<node_t> nodes; A<uint32_t> children; A<char> names; meta_t meta;
+
+        // open addressing (linear probing) table over the full paths of all nodes, folded as FOLD_CASE says, a slot
+        // holds the 32-bit path hash above node + 1 so paths are only compared on a hash match
+        A<uint64_t> slots;
+
+        // visits every array, in sidecar order
+        template<typename F>
+        void visit(F && f) {
+            f(nodes); f(children); f(names); f(slots);
+            f(meta.size); f(meta.comp_size); f(meta.offset); f(meta.mtime); f(meta.crc); f(meta.method); f(meta.flags);
+        }
+
+        string_view fpath_of(node_t const & node) const { return {names.data() + node.fpath, node.fpath_size}; }
+
+        string_view fname_of(node_t const & node) const { return {names.data() + node.fname, node.fpath_size - (node.fname - node.fpath)}; }
+
+        static uint32_t hash_of(string_view fpath) { auto h = path_hash {}(fpath); return (uint32_t)(h ^ (h >> 32)); }
+
+        // returns the slot holding fpath, or the empty slot it would go to
+        size_t probe(string_view fpath, uint32_t h) const {
+            auto mask = slots.size() - 1; for(auto i = h & mask;; i = (i + 1) & mask) {
+                auto slot = slots[i]; if(!slot) return i;
+
+                if((uint32_t)(slot >> 32) == h && path_equal {}(fpath_of(nodes[(uint32_t)slot - 1]), fpath)) return i;
+            }
+        }
+
+        int find(string_view fpath) const {
+            auto slot = slots[probe(fpath, hash_of(fpath))]; return slot ? (int)((uint32_t)slot - 1) : -1;
+        }
+
+        // every offset, range and id in the arrays stays inside them and the table has empty slots to stop probing at,
+        // checked once so that an index read from disk can be used without checks afterwards
+        bool valid() const {
+            auto n = nodes.size(); size_t used = 0;
+
+            if(!n || n > UINT32_MAX || !std::has_single_bit(slots.size()) || slots.size() < n * 2 || children.size() != n - 1 || names.empty() || names.back() != '\0') return false;
+
+            bool good = true; visit_meta([&](auto & a) { good = good && a.size() == n; }); if(!good || nodes[0].type != DIR) return false;
+
+            for(auto & node : nodes) {
+                if(node.fpath_size >= names.size() || node.fpath > names.size() - 1 - node.fpath_size || names[node.fpath + node.fpath_size] != '\0') return false;
+
+                if(node.fname < node.fpath || node.fname - node.fpath > node.fpath_size || node.parent >= n || (node.type != DIR && node.type != FILE)) return false;
+
+                if(node.first_child > children.size() || node.child_count > children.size() - node.first_child || (node.child_count && node.type != DIR)) return false;
+            }
+
+            for(auto child : children) if(!child || child >= n) return false;
+
+            for(auto slot : slots) if(slot && (++used, (uint32_t)slot - 1 >= n)) return false;
+
+            return used <= n;
+        }
+
+        template<typename F>
+        void visit_meta(F && f) const {
+            f(meta.size); f(meta.comp_size); f(meta.offset); f(meta.mtime); f(meta.crc); f(meta.method); f(meta.flags);
+        }
+    };
+
+    // builds the index from the central directory, synthesizing intermediate directories
+    // that have no entry of their own, entries may appear in any order
+    struct builder_t : index_t<array> {
+        uint32_t add_node(string_view fpath, uint32_t parent, int type) {
+            node_t node; {
+                node.fpath = (uint32_t)names.size(); node.fpath_size = (uint32_t)fpath.size(); node.parent = parent; node.type = type;
+
+                auto pos = fpath.rfind('/'); node.fname = node.fpath + (pos == string_view::npos ? 0 : (uint32_t)pos + 1);
+            }
+
+            names.insert(names.end(), fpath.begin(), fpath.end()); names.push_back('\0'); nodes.push_back(node);
+
+            return (uint32_t)nodes.size() - 1;
+        }
+
+        void rehash(size_t capacity) {
+            vector<uint64_t> old(capacity, 0); old.swap(slots); for(auto slot : old) {
+                if(slot) for(auto i = (slot >> 32) & (capacity - 1);; i = (i + 1) & (capacity - 1)) {
+                    if(!slots[i]) { slots[i] = slot; break; }
+                }
+            }
+        }
+
+        // returns the node of fpath and whether it was just added
+        pair<uint32_t, bool> find_or_add(string_view fpath, uint32_t parent, int type) {
+            auto h = hash_of(fpath); auto & slot = slots[probe(fpath, h)]; if(slot) return {(uint32_t)slot - 1, false};
+
+            auto node_index = add_node(fpath, parent, type); slot = ((uint64_t)h << 32) | (node_index + 1); {
+                // keep the load factor at or below 1/2
+                if(nodes.size() * 2 > slots.size()) rehash(slots.size() * 2);
+            }
+
+            return {node_index, true};
+        }
+
+        // inserts an entry and any missing ancestor directories into the tree
+        void add_entry(string_view fpath, bool is_dir, int findex) {
+            // make sure every ancestor exists
+            uint32_t parent = 0; for(size_t pos = fpath.find('/'); pos != string::npos; pos = fpath.find('/', pos + 1)) {
+                auto [node_index, inserted] = find_or_add(fpath.substr(0, pos), parent, DIR); if(!inserted && nodes[node_index].type != DIR) {
+                    // a file entry shadowed by a directory of the same name
+                    nodes[node_index].type = DIR; nodes[node_index].index = -1;
+                }
+
+                parent = node_index;
+            }
+
+            // files share the table with directories so that duplicates and file/dir clashes resolve to one node
+            auto [node_index, inserted] = find_or_add(fpath, parent, is_dir ? DIR : FILE); auto & node = nodes[node_index];
+
+            if(is_dir) {
+                if(node.type != DIR) {
+                    node.type = DIR; node.index = -1;
+                }
+
+                if(node.index < 0) node.index = findex;
+            }
+            else if(inserted) {
+                node.index = findex;
+            }
+        }
+
+        // the dos date/time of an entry is local time, mktime() is only called once per distinct date
+        static int64_t dos_to_time(uint16_t dos_time, uint16_t dos_date, unordered_map<uint16_t, int64_t> & midnights) {
+            auto [i, inserted] = midnights.try_emplace(dos_date, 0); if(inserted) {
+                tm t {0}; {
+                    t.tm_isdst = -1; t.tm_year = ((dos_date >> 9) & 127) + 1980 - 1900; t.tm_mon = ((dos_date >> 5) & 15) - 1; t.tm_mday = dos_date & 31;
+                }
+
+                i->second = mktime(&t);
+            }
+
+            return i->second + ((dos_time >> 11) & 31) * 3600 + ((dos_time >> 5) & 63) * 60 + ((dos_time << 1) & 62);
+        }
+
+        // fills row n of rows from a central directory header
+        static void parse_meta(meta_t & rows, size_t n, const uint8_t * p, unordered_map<uint16_t, int64_t> & midnights) {
+            uint64_t size = MZ_READ_LE32(p + ZIP_CDH_DECOMPRESSED_SIZE_OFS), comp_size = MZ_READ_LE32(p + ZIP_CDH_COMPRESSED_SIZE_OFS), offset = MZ_READ_LE32(p + ZIP_CDH_LOCAL_HEADER_OFS);
+
+            if(std::max({size, comp_size, offset}) == MZ_UINT32_MAX) {
+                // the 64-bit values only appear in the zip64 extra field for the fields saturated above
+                auto extra = p + ZIP_CDH_SIZE + MZ_READ_LE16(p + ZIP_CDH_FILENAME_LEN_OFS), end = extra + MZ_READ_LE16(p + ZIP_CDH_EXTRA_LEN_OFS);
+
+                while(extra + 4 <= end) {
+                    auto id = MZ_READ_LE16(extra), field_size = MZ_READ_LE16(extra + 2); auto field = extra + 4, field_end = std::min(field + field_size, end);
+
+                    if(id == ZIP64_EXTRA_ID) {
+                        for(auto v : {&size, &comp_size, &offset}) {
+                            if(*v == MZ_UINT32_MAX && field + 8 <= field_end) { *v = MZ_READ_LE64(field); field += 8; }
+                        }
+
+                        break;
+                    }
+
+                    extra = field + field_size;
+                }
+            }
+
+            rows.size[n] = size; rows.comp_size[n] = comp_size; rows.offset[n] = offset;
+            rows.mtime[n] = dos_to_time(MZ_READ_LE16(p + ZIP_CDH_FILE_TIME_OFS), MZ_READ_LE16(p + ZIP_CDH_FILE_DATE_OFS), midnights);
+            rows.crc[n] = MZ_READ_LE32(p + ZIP_CDH_CRC32_OFS); rows.method[n] = MZ_READ_LE16(p + ZIP_CDH_METHOD_OFS); rows.flags[n] = MZ_READ_LE16(p + ZIP_CDH_BIT_FLAG_OFS);
+        }
+
+        // per-phase wall times of the last build(), for reporting
+        vector<pair<const char *, double>> phases;
+
+        template<typename F>
+        void phase(const char * name, F && f) {
+            auto t0 = chrono::steady_clock::now(); f(); phases.emplace_back(name, chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count());
+        }
+
+        // builds the index of the archive in data; record boundaries are found in a serial pre-pass,
+        // then the records are validated and parsed in parallel chunks and sorted with a parallel
+        // merge sort, so that the (serial) tree construction sees every directory in pre-order
+        bool build(const uint8_t * data, size_t data_size, size_t & num_files) {
+            uint64_t cdir_ofs, cdir_size, count; if(!find_central_dir(data, data_size, cdir_ofs, cdir_size, count)) return false;
+
+            num_files = count; auto threads = (count < 0x10000) ? 1 : std::max<size_t>(1, thread::hardware_concurrency());
+
+            // pre-pass, only reads the three variable lengths of every record
+            vector<uint64_t> records(count); bool valid = true; phase("scan", [&] {
+                uint64_t ofs = cdir_ofs, end = cdir_ofs + cdir_size; for(auto & record : records) {
+                    if(ofs + ZIP_CDH_SIZE > end || MZ_READ_LE32(data + ofs) != ZIP_CDH_SIG) { valid = false; return; }
+
+                    record = ofs; ofs += ZIP_CDH_SIZE + MZ_READ_LE16(data + ofs + ZIP_CDH_FILENAME_LEN_OFS) + MZ_READ_LE16(data + ofs + ZIP_CDH_EXTRA_LEN_OFS) + MZ_READ_LE16(data + ofs + ZIP_CDH_COMMENT_LEN_OFS);
+
+                    if(ofs > end) { valid = false; return; }
+                }
+            });
+
+            if(!valid) return false;
+
+            // normalized paths go to one buffer per chunk, views into them stay valid as the buffers are reserved up front
+            meta_t rows; rows.resize(count); vector<string_view> paths(count); vector<uint8_t> is_dir(count); vector<string> buffers(threads); atomic<bool> corrupt {false};
+
+            phase("parse", [&] {
+                atomic<size_t> next_buffer {0}; parallel_for(count, threads, [&](size_t begin, size_t end) {
+                    auto & buffer = buffers[next_buffer++]; unordered_map<uint16_t, int64_t> midnights; string fpath; {
+                        buffer.reserve((end < count ? records[end] : cdir_ofs + cdir_size) - records[begin]);
+                    }
+
+                    for(auto findex = begin; findex < end; ++findex) {
+                        auto p = data + records[findex]; string_view fname {(const char *)p + ZIP_CDH_SIZE, MZ_READ_LE16(p + ZIP_CDH_FILENAME_LEN_OFS)};
+
+                        is_dir[findex] = normalize(fname, fpath) || (MZ_READ_LE32(p + ZIP_CDH_EXTERNAL_ATTR_OFS) & ZIP_DOS_DIR_ATTRIBUTE);
+
+                        paths[findex] = {buffer.data() + buffer.size(), fpath.size()}; buffer += fpath;
+
+                        // zip64 values may be anything, the checks must not wrap around
+                        parse_meta(rows, findex, p, midnights); auto offset = rows.offset[findex], comp_size = is_dir[findex] ? 0 : rows.comp_size[findex];
+
+                        if(offset > data_size - ZIP_LDH_SIZE || comp_size > data_size - ZIP_LDH_SIZE - offset) corrupt = true;
+                    }
+                });
+            });
+
+            if(corrupt) return false;
+
+            vector<uint32_t> order(count); phase("sort", [&] {
+                // duplicates keep their central directory order, so the first of them is always the one served
+                std::iota(order.begin(), order.end(), 0); auto less = [&](uint32_t a, uint32_t b) {
+                    return tree_less(paths[a], paths[b]) || (!tree_less(paths[b], paths[a]) && a < b);
+                };
+
+                auto chunk = (count + threads - 1) / threads; parallel_for(count, threads, [&](size_t begin, size_t end) {
+                    std::sort(order.begin() + begin, order.begin() + end, less);
+                });
+
+                for(; chunk < count; chunk *= 2) {
+                    auto pairs = (count + 2 * chunk - 1) / (2 * chunk); parallel_for(pairs, std::min(pairs, threads), [&](size_t begin, size_t end) {
+                        for(auto i = begin; i < end; ++i) {
+                            auto first = order.begin() + i * 2 * chunk; auto middle = std::min(first + chunk, order.end()), last = std::min(first + 2 * chunk, order.end());
+
+                            std::inplace_merge(first, middle, last, less);
+                        }
+                    });
+                }
+            });
+
+            phase("tree", [&] {
+                slots.assign(std::bit_ceil(std::max<size_t>(16, count * 2 + 2)), 0); {
+                    find_or_add({}, 0, DIR);
+                }
+
+                for(auto findex : order) {
+                    if(!paths[findex].empty()) add_entry(paths[findex], is_dir[findex], findex);
+                }
+
+                // nodes were created in pre-order, appending each to its parent keeps the children sorted
+                for(uint32_t i = 1; i < nodes.size(); ++i) ++nodes[nodes[i].parent].child_count;
+
+                uint32_t offset = 0; for(auto & node : nodes) {
+                    node.first_child = offset; offset += node.child_count; node.child_count = 0;
+                }
+
+                children.resize(offset); for(uint32_t i = 1; i < nodes.size(); ++i) {
+                    auto & parent = nodes[nodes[i].parent]; children[parent.first_child + parent.child_count++] = i;
+                }
+            });
+
+            phase("meta", [&] {
+                meta.resize(nodes.size()); parallel_for(nodes.size(), threads, [&](size_t begin, size_t end) {
+                    for(auto i = begin; i < end; ++i) {
+                        auto & node = nodes[i]; if(node.index < 0) continue;
+
+                        if(node.type == FILE) meta.assign(i, rows, node.index); else meta.mtime[i] = rows.mtime[node.index];
+                    }
+                });
+            });
+
+            return true;
+        }
+
+        index_t<view> as_view() {
+            index_t<view> r; {
+                r.nodes = nodes; r.children = children; r.names = names; r.slots = slots;
+                r.meta.size = meta.size; r.meta.comp_size = meta.comp_size; r.meta.offset = meta.offset; r.meta.mtime = meta.mtime;
+                r.meta.crc = meta.crc; r.meta.method = meta.method; r.meta.flags = meta.flags;
+            }
+
+            return r;
+        }
+    };
+
+    enum : uint64_t { BLOCK_SIZE = 256 << 10, READ_AHEAD = 4 << 20, CHECKPOINT_SPACING = 8 << 20 };
+
+    // a decode run in progress, watermark is the first block it has not produced yet
+    struct flight_t {
+        std::mutex mutex; std::condition_variable cv; uint64_t key {0}, watermark {0}; bool done {false}, ok {true};
+    };
+
+    size_t size {0}; policy_cache<uint64_t, buffer_t> cache {512 << 20}; std::mutex flights_mutex; std::condition_variable flights_cv; unordered_map<uint64_t, shared_ptr<flight_t>> flights;
+
+    // lands a flight when the run leaves, however it leaves, an exception included: failed unless it says otherwise,
+    // or not at all once the flight was handed on to the read-ahead
+    struct landing_t {
+        archive_t * a; shared_ptr<flight_t> flight; bool ok {false};
+
+        landing_t(archive_t * a, shared_ptr<flight_t> flight) : a(a), flight(std::move(flight)) {}
+
+        landing_t(landing_t const &) = delete; landing_t & operator=(landing_t const &) = delete;
+
+        ~landing_t() { if(flight) a->land(flight, ok); }
+    };
+
+    // read-ahead runs on a few threads shared by every reader, queued beyond them up to a limit and skipped past it
+    workers_t read_ahead_workers {std::clamp<size_t>(thread::hardware_concurrency() / 2, 1, 4), 64};
+
+    // an open file or directory, the frontend's file handle (DokanFileInfo->Context, fuse_file_info::fh) points at one; the stored bytes and the last block read stay
+    // at hand so that most reads finish without touching the shared cache
+    struct file_t {
+        int node; uint64_t size; span<const uint8_t> stored; std::mutex mutex; decltype(cache)::handle pinned; uint64_t pinned_block;
+        uint64_t src, next_offset, sequential, reads, bytes; unique_ptr<inflate_stream_t> stream; bool streaming; file_t * next_free;
+    };
+
+    std::mutex files_mutex; vector<unique_ptr<file_t[]>> file_chunks; file_t * free_files {nullptr};
+
+    // with auto-sizing on, the block stream's miss ratio curve decides the cache budget within [cache_min, cache_max]:
+    // the smallest size expected to reach hit_rate, or past which more memory would not save another percent of misses
+    unique_ptr<mrc_t> mrc; uint64_t cache_min {0}, cache_max {0}; double hit_rate {0.95}; atomic<uint64_t> accesses {0};
+
+    void auto_size(uint64_t min_bytes, uint64_t max_bytes, double rate) {
+        cache_min = min_bytes; cache_max = std::max(min_bytes, max_bytes); hit_rate = rate; mrc = make_unique<mrc_t>(cache_max);
+
+        // the bounds hold from the start, not only once the curve has seen enough to tune
+        cache.set_capacity(std::clamp<uint64_t>(cache.capacity(), cache_min, cache_max));
+    }
+
+    void tune() {
+        enum { MIN_SAMPLES = 256 }; if(mrc->samples_seen() < MIN_SAMPLES) return;
+
+        auto goal = std::max(1 - hit_rate, mrc->miss_ratio(cache_max) + 0.01); auto size = cache_max; for(auto & [bytes, miss] : mrc->curve()) {
+            if(bytes >= cache_min && miss <= goal) {
+                size = bytes; break;
+            }
+        }
+
+        if(size != cache.capacity()) cache.set_capacity(size);
+    }
+
+    // one bit per node, set once a full decode of the entry matched its crc so later ones skip the checksum
+    unique_ptr<atomic<uint64_t>[]> verified; const codec_t * codec {&codecs[0]};
+
+    bool is_verified(int node_index) const { return verified[node_index / 64].load(std::memory_order_relaxed) >> (node_index % 64) & 1; }
+
+    void set_verified(int node_index) { verified[node_index / 64].fetch_or(1ull << (node_index % 64), std::memory_order_relaxed); } mapping_t fmapping, imapping;
+
+    index_t<view> index; unique_ptr<builder_t> built; vector<pair<const char *, double>> phases;
+
+    // the read-ahead still running in the background uses the archive
+    ~archive_t() { drain(); }
+
+    // maps the archive and loads its index from the sidecar, or builds it and writes the sidecar; false if the
+    // file cannot be mapped or is not a zip
+    bool open(string const & fname) {
+        if(!fmapping.map(fname)) return false;
+
+        auto signature = signature_of(fname); auto iname = fname + ".zmidx"; if(load_sidecar(iname, signature)) {
+            verified.reset(new atomic<uint64_t>[index.nodes.size() / 64 + 1] {}); return true;
+        }
+
+        // no usable sidecar, build the index from the central directory
+        built = make_unique<builder_t>(); if(!built->build(data(), data_size(), size)) return false; {
+            index = built->as_view(); phases = built->phases;
+        }
+
+        // once written, serve the index from the page cache instead of the heap
+        if(save_sidecar(iname, signature) && load_sidecar(iname, signature)) built.reset();
+
+        verified.reset(new atomic<uint64_t>[index.nodes.size() / 64 + 1] {}); return true;
+    }
+
+    const uint8_t * data() const { return fmapping.data(); }
+
+    size_t data_size() const { return fmapping.size(); }
+
+    sidecar_t signature_of(string const & fname) {
+        sidecar_t r {0}; {
+            std::copy(std::begin(sidecar_t::MAGIC), std::end(sidecar_t::MAGIC), r.magic); r.version = sidecar_t::VERSION; r.sections = sidecar_t::SECTIONS; r.fold_case = FOLD_CASE;
+
+            error_code ec; r.archive_size = data_size(); r.archive_mtime = fs::last_write_time(fname, ec).time_since_epoch().count();
+
+            // the end of central directory record sits in the last 22 + 64k (comment) bytes
+            auto tail = std::min<size_t>(data_size(), 22 + 0xFFFF); r.eocd_crc = (uint32_t)mz_crc32(MZ_CRC32_INIT, data() + data_size() - tail, tail);
+        }
+
+        return r;
+    }
+
+    bool load_sidecar(string const & iname, sidecar_t const & signature) {
+        error_code ec; if(!fs::exists(iname, ec)) return false;
+
+        if(!imapping.map(iname) || imapping.size() < sizeof(sidecar_t)) return false;
+
+        auto base = imapping.data(); auto & header = *(const sidecar_t *)base;
+
+        auto matches = !memcmp(header.magic, signature.magic, sizeof(header.magic)) && header.version == signature.version && header.sections == signature.sections &&
+            header.archive_size == signature.archive_size && header.archive_mtime == signature.archive_mtime && header.eocd_crc == signature.eocd_crc && header.fold_case == signature.fold_case;
+
+        index_t<view> r; size_t i = 0; if(matches) r.visit([&](auto & a) {
+            using T = typename std::remove_reference_t<decltype(a)>::value_type; auto & s = header.section[i++];
+
+            if(s.offset % alignof(T) || s.offset > imapping.size() || s.count > (imapping.size() - s.offset) / sizeof(T)) {
+                matches = false; return;
+            }
+
+            a = {(const T *)(base + s.offset), (size_t)s.count};
+        });
+
+        // a sidecar that matches but does not hold together is rebuilt like a stale one
+        if(!matches || !r.valid()) {
+            imapping.unmap(); return false;
+        }
+
+        index = r; size = header.num_files; return true;
+    }
+
+    bool save_sidecar(string const & iname, sidecar_t signature) {
+        // a name of its own per writer, so that two processes opening the same archive never write into one file
+        static atomic<uint32_t> serial {0};
+
+#ifdef _WIN32
+        auto tname = format("{}.{}.{}.tmp", iname, GetCurrentProcessId(), serial++);
+#else
+        auto tname = format("{}.{}.{}.tmp", iname, getpid(), serial++);
+#endif
+
+        auto f = fopen(tname.c_str(), "wb"); if(!f) return false;
+
+        uint64_t offset = sizeof(sidecar_t), i = 0; index.visit([&](auto & a) {
+            offset = (offset + 7) & ~7ull; signature.section[i++] = {offset, a.size()}; offset += a.size_bytes();
+        });
+
+        signature.num_files = (uint32_t)size; auto good = fwrite(&signature, sizeof(signature), 1, f) == 1; offset = sizeof(signature); i = 0;
+
+        index.visit([&](auto & a) {
+            static const char zeros[8] {}; auto pad = signature.section[i++].offset - offset; offset += pad + a.size_bytes();
+
+            good = good && fwrite(zeros, 1, pad, f) == pad && (a.empty() || fwrite(a.data(), 1, a.size_bytes(), f) == a.size_bytes());
+        });
+
+        // on disk before the rename, or a crash could leave the new name on a file that was never written
+#ifdef _WIN32
+        good = good && !fflush(f) && !_commit(_fileno(f));
+#else
+        good = good && !fflush(f) && !fsync(fileno(f));
+#endif
+
+        good = !fclose(f) && good;
+
+        error_code ec; if(good) fs::rename(tname, iname, ec); good = good && !ec; if(!good) fs::remove(tname, ec);
+
+        return good;
+    }
+
+    // offset of an entry's data in the archive, 0 if the local header is broken or the entry cannot be read
+    uint64_t data_offset(int node_index) {
+        auto comp_size = index.meta.comp_size[node_index], offset = index.meta.offset[node_index];
+
+        if(index.meta.flags[node_index] & 1) return 0; // encrypted
+
+        // zip64 sizes and offsets go up to 2^64, the checks subtract from the size of the mapping instead of adding to them
+        if(data_size() < ZIP_LDH_SIZE || offset > data_size() - ZIP_LDH_SIZE || MZ_READ_LE32(data() + offset) != 0x04034b50) return 0;
+
+        // the local header repeats the name and may carry a different extra field than the central one
+        offset += ZIP_LDH_SIZE + MZ_READ_LE16(data() + offset + 26) + MZ_READ_LE16(data() + offset + 28); if(offset > data_size() || comp_size > data_size() - offset) return 0;
+
+        switch(index.meta.method[node_index]) {
+            // a stored entry is its own data, so its size is bounded by what is left of the mapping like comp_size
+            case 0: if(comp_size != index.meta.size[node_index]) return 0; break;
+            case MZ_DEFLATED: break;
+            default: return 0;
+        }
+
+        return offset;
+    }
+
+    stat_t stat(int node_index) {
+        auto & node = index.nodes[node_index];
+
+        stat_t r; {
+            r.fpath = index.fpath_of(node); r.fname = index.fname_of(node); r.size = index.meta.size[node_index]; r.mtime = index.meta.mtime[node_index]; r.type = node.type;
+        }
+
+        return r;
+    }
+
+    entry_t locate(string_view fpath) {
+        while(!fpath.empty() && fpath.back() == '/') fpath.remove_suffix(1);
+
+        auto node_index = index.find(fpath); if(node_index < 0) return {};
+
+        return {index.nodes[node_index].type, node_index};
+    }
+
+    // the bytes of a stored entry inside the archive mapping, empty for anything else
+    span<const uint8_t> mapped(int node_index) {
+        if(index.meta.method[node_index] != 0) return {};
+
+        auto src = data_offset(node_index); if(!src) return {};
+
+        return {data() + src, (size_t)index.meta.size[node_index]};
+    }
+
+    static uint64_t block_key(int node_index, uint64_t block) { return (uint64_t)node_index << 32 | block; }
+
+    // decoder snapshots share the cache and its budget with the blocks, under keys of their own
+    static uint64_t checkpoint_key(int node_index, uint64_t checkpoint) { return (uint64_t)node_index << 32 | 1u << 31 | checkpoint; }
+
+    file_t * open_file(int node_index) {
+        file_t * f; {
+            std::lock_guard<std::mutex> lock(files_mutex); if(!free_files) {
+                auto & chunk = file_chunks.emplace_back(new file_t[64]); for(int i = 0; i < 64; ++i) {
+                    chunk[i].next_free = free_files; free_files = &chunk[i];
+                }
+            }
+
+            f = free_files; free_files = f->next_free;
+        }
+
+        auto is_file = index.nodes[node_index].type == FILE; {
+            f->node = node_index; f->size = is_file ? index.meta.size[node_index] : 0; f->stored = is_file ? mapped(node_index) : span<const uint8_t> {};
+            f->pinned = {}; f->pinned_block = 0; f->src = f->next_offset = f->sequential = f->reads = f->bytes = 0; f->streaming = false;
+        }
+
+        return f;
+    }
+
+    void close_file(file_t * f) {
+        f->pinned = {}; std::lock_guard<std::mutex> lock(files_mutex); f->next_free = free_files; free_files = f;
+    }
+
+    // continues the file's own decoder, restarting it from the closest checkpoint when it is past offset or too far
+    // behind; f.mutex is held
+    bool stream(file_t & f, uint64_t offset, void * dst, size_t n) {
+        if(!f.stream) f.stream.reset(new inflate_stream_t);
+
+        auto & st = *f.stream; if(!f.streaming || offset < st.out_ofs || offset - st.out_ofs > READ_AHEAD) {
+            auto src = f.src; auto comp_size = index.meta.comp_size[f.node];
+
+            st.init(data() + src, comp_size, !is_verified(f.node)); for(auto c = offset / CHECKPOINT_SPACING; c; --c) {
+                if(auto h = cache.get(checkpoint_key(f.node, c))) {
+                    st.restore(data() + src, comp_size, *h); break;
+                }
+            }
+
+            f.streaming = true;
+        }
+
+        f.streaming = false; uint8_t skip[4096]; while(st.out_ofs < offset) {
+            auto k = std::min<uint64_t>(sizeof(skip), offset - st.out_ofs); if(st.read(skip, k) != k) return false;
+        }
+
+        if(st.read((uint8_t *)dst, n) != n) return false;
+
+        // the checksum can only be verified once the whole entry went through
+        if(st.out_ofs == f.size && st.check) {
+            if(!st.done() || st.crc != index.meta.crc[f.node]) return false; set_verified(f.node);
+        }
+
+        f.streaming = true; return true;
+    }
+
+    // reads through an open file, offset + n must be within the file
+    bool read(file_t & f, uint64_t offset, void * dst, size_t n) {
+        if(!f.stored.empty()) {
+            memcpy(dst, f.stored.data() + offset, n);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(f.mutex); f.sequential = offset == f.next_offset ? f.sequential + 1 : 0; f.next_offset = offset + n; ++f.reads; f.bytes += n;
+
+            if(!f.stored.empty()) return true;
+
+            // the local header is parsed on the first read only, decoding then reads the mapping in place
+            if(!f.src && !(f.src = data_offset(f.node))) return false;
+
+            // entries too large to cache are read by sequential readers through a decoder of their own, so that
+            // streaming one costs a single pass and a window's worth of memory
+            auto large = index.meta.method[f.node] == MZ_DEFLATED && f.size > cache.capacity() / 4; if(large) {
+                auto near = f.streaming && offset >= f.stream->out_ofs && offset - f.stream->out_ofs <= READ_AHEAD; if(near || offset == 0 || f.sequential >= 2) {
+                    return stream(f, offset, dst, n);
+                }
+            }
+
+            if(f.pinned && offset / BLOCK_SIZE == f.pinned_block && (offset + n - 1) / BLOCK_SIZE == f.pinned_block) {
+                memcpy(dst, f.pinned->data() + (offset - f.pinned_block * BLOCK_SIZE), n); return true;
+            }
+        }
+
+        if(!read(f.node, f.src, offset, dst, n)) return false;
+
+        // keep the block the read ended in, a sequential reader starts the next read there; the read above already
+        // counted it as a use, or inserted it
+        auto block = (offset + n - 1) / BLOCK_SIZE; auto pinned = cache.peek(block_key(f.node, block)); {
+            std::lock_guard<std::mutex> lock(f.mutex); f.pinned = std::move(pinned); f.pinned_block = block;
+        }
+
+        return true;
+    }
+
+    // every block asked for feeds the miss ratio curve, every so often the cache is resized along it
+    void sample(int node_index, uint64_t offset, size_t n) {
+        enum { TUNE_INTERVAL = 4096 }; if(!mrc) return;
+
+        auto size = index.meta.size[node_index]; for(auto block = offset / BLOCK_SIZE; block * BLOCK_SIZE < offset + n; ++block) {
+            mrc->access(block_key(node_index, block), std::min<uint64_t>(BLOCK_SIZE, size - block * BLOCK_SIZE));
+
+            if(++accesses % TUNE_INTERVAL == 0) tune();
+        }
+    }
+
+    // hands [offset, offset + n) of an open deflated file to reply() as slices of the cached blocks, pinned until it
+    // returns, instead of copying them; false, without calling reply(), unless every block is cached already, the
+    // caller then goes through read() which decodes what is missing
+    template<typename F>
+    bool borrow(file_t & f, uint64_t offset, size_t n, F && reply) {
+        enum { MAX_BLOCKS = 16 }; auto first = offset / BLOCK_SIZE, last = (offset + n - 1) / BLOCK_SIZE;
+
+        if(!f.stored.empty() || !n || last - first >= MAX_BLOCKS) return false;
+
+        {
+            std::lock_guard<std::mutex> lock(f.mutex); if(!f.src && !(f.src = data_offset(f.node))) return false;
+
+            // streamed entries never enter the cache
+            if(index.meta.method[f.node] == MZ_DEFLATED && f.size > cache.capacity() / 4) return false;
+        }
+
+        // probed without telling the policy, a miss falls back to read() which counts the blocks it uses itself;
+        // the pinned handles serve the reply even if one is evicted before its use is counted below
+        decltype(cache)::handle blocks[MAX_BLOCKS]; span<const uint8_t> slices[MAX_BLOCKS]; for(auto block = first; block <= last; ++block) {
+            auto & h = blocks[block - first]; if(!(h = cache.peek(block_key(f.node, block)))) return false;
+
+            auto lo = std::max(offset, block * BLOCK_SIZE), hi = std::min(offset + n, block * BLOCK_SIZE + h->size());
+
+            slices[block - first] = {h->data() + (lo - block * BLOCK_SIZE), (size_t)(hi - lo)};
+        }
+
+        for(auto block = first; block <= last; ++block) cache.get(block_key(f.node, block));
+
+        {
+            std::lock_guard<std::mutex> lock(f.mutex); f.sequential = offset == f.next_offset ? f.sequential + 1 : 0; f.next_offset = offset + n; ++f.reads; f.bytes += n;
+
+            f.pinned = blocks[last - first]; f.pinned_block = last;
+        }
+
+        sample(f.node, offset, n); reply(span<const span<const uint8_t>> {slices, (size_t)(last - first + 1)}); return true;
+    }
+
+    // copies [offset, offset + n) of a file whose data starts at src into dst through the block cache, false if the
+    // entry is corrupt
+    bool read(int node_index, uint64_t src, uint64_t offset, void * dst, size_t n) {
+        auto end = offset + n; auto take = [&](uint64_t block, buffer_t const & s) {
+            auto lo = std::max(offset, block * BLOCK_SIZE), hi = std::min(end, block * BLOCK_SIZE + s.size()); if(lo < hi) {
+                memcpy((uint8_t *)dst + (lo - offset), s.data() + (lo - block * BLOCK_SIZE), hi - lo);
+            }
+        };
+
+        // stored entries are served straight from the mapping and never enter the cache
+        if(!src) return false; if(index.meta.method[node_index] == 0) {
+            memcpy(dst, data() + src + offset, n); return true;
+        }
+
+        sample(node_index, offset, n);
+
+        shared_ptr<flight_t> waited; uint64_t waited_block = 0; for(auto block = offset / BLOCK_SIZE; block * BLOCK_SIZE < end;) {
+            if(auto s = cache.get(block_key(node_index, block))) {
+                take(block, *s); ++block; continue;
+            }
+
+            auto size = index.meta.size[node_index];
+
+            // deflate has no random access, decode from the closest checkpoint (or the start) through the rest
+            // of the request plus some read-ahead
+            auto blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE, last = std::min(blocks, (end - 1) / BLOCK_SIZE + 1 + read_ahead());
+
+            auto c = block * BLOCK_SIZE / CHECKPOINT_SPACING; decltype(cache)::handle checkpoint; for(; c; --c) {
+                if((checkpoint = cache.get(checkpoint_key(node_index, c)))) break;
+            }
+
+            // one decode run per starting point at a time, readers arriving meanwhile wait until it got past their
+            // block and look in the cache again, or until it ended if the block still is not there
+            auto key = checkpoint_key(node_index, c); shared_ptr<flight_t> flight; bool leader = false; {
+                std::lock_guard<std::mutex> lock(flights_mutex); auto & f = flights[key]; if(!f) {
+                    f = make_shared<flight_t>(); f->key = key; leader = true;
+                }
+
+                flight = f;
+            }
+
+            if(!leader) {
+                auto again = (flight == waited && block == waited_block); waited = flight; waited_block = block;
+
+                std::unique_lock<std::mutex> lock(flight->mutex); flight->cv.wait(lock, [&] { return flight->done || (!again && flight->watermark > block); });
+
+                if(flight->done && !flight->ok) return false; continue;
+            }
+
+            // the flight lands either way, running out of memory only fails this read
+            auto want = (end - 1) / BLOCK_SIZE + 1; try {
+                return decode(node_index, src, c * (CHECKPOINT_SPACING / BLOCK_SIZE), checkpoint ? &*checkpoint : nullptr, block, want, last, flight, take);
+            }
+            catch(std::bad_alloc const &) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // decodes blocks [first, last), resuming from a saved decoder state unless first is 0, caching every block from
+    // the missing one on and leaving a checkpoint every CHECKPOINT_SPACING bytes of output; blocks before want go to
+    // take() and the caller gets its answer as soon as they are done, the rest is decoded by the read-ahead workers
+    struct no_take {
+        void operator()(uint64_t, buffer_t const &) const {}
+    };
+
+    template<typename F>
+    bool decode(int node_index, uint64_t src, uint64_t first, const buffer_t * state, uint64_t block, uint64_t want, uint64_t last, shared_ptr<flight_t> flight, F && take) {
+        auto size = index.meta.size[node_index], blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE; landing_t landing {this, std::move(flight)};
+
+        if(first == 0 && last == blocks) return decode_whole(node_index, src, block, landing, take);
+
+        // the decoder state is large, each thread keeps one around
+        thread_local inflate_stream_t stream; auto comp_size = index.meta.comp_size[node_index]; stream.init(data() + src, comp_size, !is_verified(node_index));
+
+        if(state) stream.restore(data() + src, comp_size, *state);
+
+        buffer_t s; for(uint64_t i = first; i < last; ++i) {
+            if(i && i % (CHECKPOINT_SPACING / BLOCK_SIZE) == 0) {
+                auto key = checkpoint_key(node_index, i / (CHECKPOINT_SPACING / BLOCK_SIZE)); if(!cache.contains(key)) cache.insert(key, stream.save(data() + src), (double)CHECKPOINT_SPACING);
+            }
+
+            auto length = std::min<uint64_t>(BLOCK_SIZE, size - i * BLOCK_SIZE); if(s.size() != length) s = buffer_t(length);
+
+            if(stream.read(s.data(), s.size()) != s.size()) {
+                for(auto j = block; j < i; ++j) cache.erase(block_key(node_index, j)); return false;
+            }
+
+            if(i < block) continue;
+
+            // what it would take to decode the block again from its checkpoint
+            take(i, s); cache.insert(block_key(node_index, i), std::move(s), (double)((i % (CHECKPOINT_SPACING / BLOCK_SIZE) + 1) * BLOCK_SIZE)); {
+                std::lock_guard<std::mutex> lock(landing.flight->mutex); landing.flight->watermark = i + 1;
+            }
+
+            landing.flight->cv.notify_all();
+
+            // the caller has everything it asked for, the read-ahead goes on without it; with the workers' queue full
+            // the flight lands here and later readers decode the rest themselves
+            if(i + 1 == want && want < last) {
+                auto task = [this, node_index, src, want, last, flight = landing.flight, state = stream.save(data() + src)] {
+                    try { decode(node_index, src, want, &state, want, last, last, flight, no_take {}); } catch(std::bad_alloc const &) {}
+                };
+
+                if(read_ahead_workers.submit(std::move(task))) landing.flight = nullptr; else landing.ok = true;
+
+                return true;
+            }
+        }
+
+        // the checksum can only be verified once the whole entry went through
+        auto ok = !(last == blocks && stream.check && (!stream.done() || stream.crc != index.meta.crc[node_index])); if(!ok) {
+            for(auto j = block; j < last; ++j) cache.erase(block_key(node_index, j));
+        }
+        else if(last == blocks && stream.check) {
+            set_verified(node_index);
+        }
+
+        landing.ok = ok; return ok;
+    }
+
+    // a run over the whole entry has all input and output at hand, the codec decodes it in one go
+    template<typename F>
+    bool decode_whole(int node_index, uint64_t src, uint64_t block, landing_t & landing, F && take) {
+        auto size = index.meta.size[node_index]; buffer_t buffer(size);
+
+        auto ok = codec->inflate(data() + src, index.meta.comp_size[node_index], buffer.data(), size); if(ok && !is_verified(node_index)) {
+            ok = mz_crc32(MZ_CRC32_INIT, buffer.data(), size) == index.meta.crc[node_index]; if(ok) set_verified(node_index);
+        }
+
+        // an entry of a single block goes into the cache as it is
+        if(ok && size <= BLOCK_SIZE) {
+            take(0, buffer); cache.insert(block_key(node_index, 0), std::move(buffer), (double)size);
+        }
+
+        for(auto i = block; ok && size > BLOCK_SIZE && i * BLOCK_SIZE < size; ++i) {
+            buffer_t s(std::min<uint64_t>(BLOCK_SIZE, size - i * BLOCK_SIZE)); memcpy(s.data(), buffer.data() + i * BLOCK_SIZE, s.size()); take(i, s);
+
+            cache.insert(block_key(node_index, i), std::move(s), (double)size);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(landing.flight->mutex); landing.flight->watermark = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        }
+
+        landing.ok = ok; return ok;
+    }
+
+    void land(shared_ptr<flight_t> const & flight, bool ok) {
+        {
+            std::lock_guard<std::mutex> lock(flights_mutex); flights.erase(flight->key); flights_cv.notify_all();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(flight->mutex); flight->done = true; flight->ok = ok;
+        }
+
+        flight->cv.notify_all();
+    }
+
+    // waits for the read-ahead still running in the background, call it before the archive goes away
+    void drain() {
+        std::unique_lock<std::mutex> lock(flights_mutex); flights_cv.wait(lock, [&] { return flights.empty(); });
+    }
+
+    uint64_t read_ahead() const { return std::min<uint64_t>(READ_AHEAD, cache.capacity() / 8) / BLOCK_SIZE; }
+
+    template<typename F>
+    void each(string const & fname, F && f) {
+        auto ent = locate(fname); if(ent.is_dir()) {
+            auto & node = index.nodes[ent.index]; for(uint32_t i = 0; i < node.child_count; ++i) {
+                f(stat(index.children[node.first_child + i]));
+            }
+        }
+    }
+};
+
+} // namespace zipmount::detail
+
+// frontends mount one archive, the library builds without them
+#ifndef ZIPMOUNT_LIBRARY
+using namespace zipmount::detail;
+
+static constexpr const char * APP_NAME = "zipmount";
+static constexpr const char * APP_VERSION = "0.1.0";
+
+// prints "[time] what" and then whether it worked, exits on failure
+static struct ok_type {
+    bool epilogue {false};
+
+    void failed(int rc = 1) { if(epilogue) { print("failed\n"); epilogue = false; } exit(rc); }
+
+    void succeeded() { if(epilogue) { print("\n"); epilogue = false; } }
+
+    ok_type & operator=(int rc) {
+        if(rc) failed(rc); else succeeded(); ; return *this;
+    }
+
+    template<typename T, std::enable_if_t<std::is_same_v<T, bool>, int> = 0>
+    ok_type & operator=(T b) {
+        if(!b) failed(); else succeeded(); ; return *this;
+    }
+
+    template<typename T>
+    ok_type & operator()(T && s) {
+        auto now = std::chrono::system_clock::now();
+        auto time_point = std::chrono::floor<std::chrono::seconds>(now);
+        auto time_of_day = std::chrono::hh_mm_ss {time_point - std::chrono::floor<std::chrono::days>(time_point)};
+
+        epilogue = true; print("[{:%T}] {}", time_of_day, s); return *this;
+    }
+} ok;
+
+static archive_t $archive;
+
+// checks and opens the archive named in the options and sets the cache up as they say; every frontend has
+// archive_fname, cache_size, codec, policy, cache_min, cache_max and hit_rate among its options
+template<typename O>
+static void prepare(O const & options) {
+    ok(format("check {}", options.archive_fname)) =
+        fs::exists(options.archive_fname);
+
+    $archive.cache.set_capacity(options.cache_size.value() << 20);
+
+    auto codec = find_if(begin(codecs), end(codecs), [&](auto & c) { return options.codec.value() == c.name; });
+
+    ok(format("codec {}", options.codec.value())) = codec != end(codecs); $archive.codec = codec;
+
+    auto policy = make_policy(options.policy.value());
+
+    ok(format("policy {}", options.policy.value())) = policy != nullptr; $archive.cache.set_policy(std::move(policy));
+
+    // a maximum turns on auto-sizing, cache_size is then only where it starts
+    if(options.cache_max) {
+        ok(format("cache {}-{} MiB, {}% hits", options.cache_min.value(), options.cache_max.value(), options.hit_rate.value())) =
+            options.hit_rate.value() > 0 && options.hit_rate.value() <= 100;
+
+        $archive.auto_size(options.cache_min.value() << 20, options.cache_max.value() << 20, options.hit_rate.value() / 100);
+    }
+
+    ok(format("open  {}", options.archive_fname)) =
+        $archive.open(options.archive_fname);
+
+    if(!$archive.phases.empty()) {
+        string s; for(auto & [name, ms] : $archive.phases) s += format(" {} {:.1f}ms", name, ms);
+
+        ok(format("index{}", s)) = true;
+    }
+}
+
+// waits for the background decoding and reports what auto-sizing found, once the frontend stopped
+static void finish() {
+    $archive.drain(); if($archive.mrc) {
+        string s; for(uint64_t mb = 1; mb <= ($archive.cache_max >> 20); mb *= 2) s += format(" {}M {:.1f}%", mb, $archive.mrc->miss_ratio(mb << 20) * 100);
+
+        ok(format("cache {} MiB, miss ratio{}", $archive.cache.capacity() >> 20, s)) = true;
+    }
+}
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <sys/resource.h>
+
+// what the benchmarks share: archives come from test/zip_writer.h, timings from the steady clock and memory figures
+// from getrusage(); every benchmark prints one line per measurement
+#include "../test/zip_writer.h"
+
+static string bench_name(string const & name) { return (fs::temp_directory_path() / ("zipmount_bench_" + name)).string(); }
+
+// seconds f() took
+template<typename F>
+static double timed(F && f) {
+    auto t0 = chrono::steady_clock::now(); f(); return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+}
+
+// the process's peak resident set and page faults so far
+struct usage_t {
+    uint64_t max_rss_kb, minor_faults, major_faults;
+
+    static usage_t now() {
+        rusage u {}; getrusage(RUSAGE_SELF, &u); return {(uint64_t)u.ru_maxrss, (uint64_t)u.ru_minflt, (uint64_t)u.ru_majflt};
+    }
+};
+
+// text-like bytes, so that deflate has something to do, different per seed
+static string text(size_t size, uint32_t seed) {
+    string r(size, 0); for(size_t i = 0; i < size; ++i) {
+        seed = seed * 1103515245 + 12345; r[i] = "abcdefgh ijklm\n"[(seed >> 16) % 15];
+    }
+
+    return r;
+}
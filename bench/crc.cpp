@@ -0,0 +1,56 @@
+#include "stdafx.h"
+#include "archive.h"
+
+#include "bench.h"
+
+// crc32 throughput from 64 bytes to 64 MiB: mz_crc32() as crc32.cpp dispatches it (carry-less multiply folding or the
+// armv8 crc instructions where the cpu has them, slicing-by-16 otherwise) against the byte-at-a-time table loop miniz
+// shipped, which the table column repeats; both must agree on every size
+//
+//   crc [MiB per size]
+static uint32_t table[256];
+
+static uint32_t table_crc32(uint32_t crc, const uint8_t * p, size_t n) {
+    uint32_t c = ~crc;
+
+    // miniz's loop, four bytes an iteration
+    for(; n >= 4; p += 4, n -= 4) {
+        c = (c >> 8) ^ table[(c ^ p[0]) & 0xFF]; c = (c >> 8) ^ table[(c ^ p[1]) & 0xFF];
+        c = (c >> 8) ^ table[(c ^ p[2]) & 0xFF]; c = (c >> 8) ^ table[(c ^ p[3]) & 0xFF];
+    }
+
+    for(; n; ++p, --n) c = (c >> 8) ^ table[(c ^ *p) & 0xFF];
+
+    return ~c;
+}
+
+int main(int argc, char ** argv) {
+    auto total = (size_t)(argc > 1 ? atoi(argv[1]) : 256) << 20;
+
+    for(uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i; for(int k = 0; k < 8; ++k) c = c & 1 ? (c >> 1) ^ 0xEDB88320 : c >> 1; table[i] = c;
+    }
+
+    auto data = text(64 << 20, 7);
+
+    bool agree = true; print("size        dispatched MB/s   table MB/s   speedup\n");
+
+    for(size_t size = 64; size <= data.size(); size *= 4) {
+        // the same bytes in total for every size, at least one pass
+        auto passes = std::max<size_t>(1, total / size); auto p = (const uint8_t *)data.data();
+
+        uint32_t fast = 0; auto dispatched = timed([&] {
+            for(size_t i = 0; i < passes; ++i) fast = (uint32_t)mz_crc32(fast, p, size);
+        });
+
+        uint32_t slow = 0; auto tabled = timed([&] {
+            for(size_t i = 0; i < passes; ++i) slow = table_crc32(slow, p, size);
+        });
+
+        agree = agree && fast == slow;
+
+        auto bytes = (double)passes * size / 1e6; print("{:>8} B   {:15.0f}   {:10.0f}   {:6.1f}x\n", size, bytes / dispatched, bytes / tabled, tabled / dispatched);
+    }
+
+    ok("dispatched and table crc32 agree") = agree; return 0;
+}
@@ -0,0 +1,40 @@
+#include "stdafx.h"
+#include "archive.h"
+
+#include "bench.h"
+
+// what a cache hit costs as the cached value grows to 64 MiB: policy_cache hands out a pinned handle, the lru_cache
+// it replaced copy-constructed the value on every hit of an entry that was not at the front, which the copy column
+// repeats; hits alternate between two entries of the size so that each one is a hit on the entry behind
+//
+//   hit [hits per size]
+int main(int argc, char ** argv) {
+    auto hits = argc > 1 ? atoi(argv[1]) : 100000;
+
+    print("value size   handle ns/hit   copy ns/hit\n");
+
+    for(size_t size = 4 << 10; size <= 64 << 20; size *= 4) {
+        policy_cache<uint64_t, buffer_t> cache {256 << 20}; cache.set_policy(make_policy("lru")); for(uint64_t key : {0, 1}) {
+            buffer_t b(size); memset(b.data(), (int)key, size); cache.insert(key, std::move(b));
+        }
+
+        uint64_t sum = 0; auto handle = timed([&] {
+            for(int i = 0; i < hits; ++i) {
+                auto h = cache.get(i & 1); sum += h->data()[i % size];
+            }
+        });
+
+        // copies are slow at the larger sizes, fewer of them give the same per-hit figure
+        auto copies = (int)std::max<size_t>(8, std::min<size_t>(hits, (1ull << 32) / size)); auto copy = timed([&] {
+            for(int i = 0; i < copies; ++i) {
+                auto h = cache.get(i & 1); string value((const char *)h->data(), h->size()); sum += (uint8_t)value[i % size];
+            }
+        });
+
+        print("{:>7} KiB   {:13.1f}   {:11.1f}\n", size >> 10, handle / hits * 1e9, copy / copies * 1e9);
+
+        if(sum == 42) print("\n");
+    }
+
+    return 0;
+}
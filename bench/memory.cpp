@@ -0,0 +1,55 @@
+#include "stdafx.h"
+#include "archive.h"
+
+#include <sys/wait.h>
+
+#include "bench.h"
+
+// what decompressed buffers cost in memory traffic: a cache-like churn of decodes, each into a new buffer while the
+// oldest few are dropped, once into zero-filled std::strings from the general heap (as read() allocated before) and
+// once into buffer_t (uninitialized, pooled, huge pages for large ones); each runs in a child process of its own so
+// that its peak rss and page faults are its alone
+//
+//   memory [entry MiB] [decodes]
+int main(int argc, char ** argv) {
+    auto entry_size = (size_t)(argc > 1 ? atoi(argv[1]) : 8) << 20; auto decodes = argc > 2 ? atoi(argv[2]) : 200;
+
+    enum { ENTRIES = 16, RESIDENT = 8 };
+
+    auto fname = bench_name("memory.zip"); zip_writer_t zip; for(int i = 0; i < ENTRIES; ++i) zip.add(format("f{}.bin", i), text(entry_size, i), true);
+
+    ok(format("write {}", fname)) = zip.save(fname);
+
+    archive_t a; ok(format("open  {}", fname)) = a.open(fname);
+
+    vector<pair<const uint8_t *, size_t>> sources; for(int i = 0; i < ENTRIES; ++i) {
+        auto node = a.locate(format("f{}.bin", i)).index; sources.push_back({a.data() + a.data_offset(node), (size_t)a.index.meta.comp_size[node]});
+    }
+
+    auto churn = [&](auto && allocate) {
+        deque<decltype(allocate())> resident; for(int i = 0; i < decodes; ++i) {
+            auto & [src, n] = sources[(i * 7) % ENTRIES]; auto b = allocate(); if(!inflate_fast(src, n, (uint8_t *)b.data(), entry_size)) exit(1);
+
+            resident.push_back(std::move(b)); if(resident.size() > RESIDENT) resident.pop_front();
+        }
+    };
+
+    auto measure = [&](const char * name, auto && allocate) {
+        fflush(stdout); if(auto pid = fork()) {
+            int status; waitpid(pid, &status, 0); return;
+        }
+
+        auto before = usage_t::now(); auto t = timed([&] { churn(allocate); }); auto after = usage_t::now();
+
+        print("{:<12} {:6.2f} s  {:8.0f} MB/s  peak rss {:6} MiB  minor faults {:8}  major {}\n", name, t, decodes * (double)entry_size / t / 1e6, after.max_rss_kb >> 10,
+            after.minor_faults - before.minor_faults, after.major_faults - before.major_faults);
+
+        fflush(stdout); _exit(0);
+    };
+
+    measure("std::string", [&] { return string(entry_size, 0); });
+
+    measure("buffer_t", [&] { return buffer_t(entry_size); });
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include "stdafx.h"
+#include "archive.h"
+
+#include "bench.h"
+
+// a trace-driven simulator of the eviction policies: every access of the trace goes to a policy_cache of sized
+// placeholders under lru, gdsf and tinylfu in turn, a miss decodes the entry again and inserts it; reports the hit
+// ratio, the byte hit ratio and the bytes decompressed on misses per policy and cache size
+//
+// the trace is a file of "key size cost" lines, cost being the bytes decoded to rebuild the value (1 for a stored
+// entry, its size for a deflated one), or without one a synthetic trace: zipf-distributed reads over a working set of
+// mixed sizes, a find-like sweep over cold entries cutting through it every so often
+//
+//   policies [trace file]
+struct access_t {
+    uint64_t key; uint64_t size; double cost;
+};
+
+// stands in for a decoded value, the cache only asks for its size
+struct placeholder_t {
+    size_t n; size_t size() const { return n; }
+};
+
+static vector<access_t> synthetic() {
+    enum { ENTRIES = 100000, ACCESSES = 2000000, SWEEP_EVERY = 250000, SWEEP = 30000 };
+
+    uint64_t rng = 42; auto u = [&] { rng = rng * 6364136223846793005ull + 1442695040888963407ull; return (double)(rng >> 11) / (1ull << 53); };
+
+    // sizes from 1 KiB to 4 MiB, mostly small; seven in ten deflated
+    auto entry = [&](uint64_t key) {
+        auto x = u(); uint64_t size = 1024 + (uint64_t)(x * x * x * (4 << 20)); return access_t {key, size, u() < 0.7 ? (double)size : 1.0};
+    };
+
+    vector<access_t> entries; for(uint64_t i = 0; i < ENTRIES; ++i) entries.push_back(entry(i));
+
+    vector<double> cdf(ENTRIES); double sum = 0; for(int i = 0; i < ENTRIES; ++i) cdf[i] = sum += 1 / pow(i + 1, 0.9);
+
+    vector<access_t> r; uint64_t cold = ENTRIES; for(int i = 0; i < ACCESSES; ++i) {
+        if(i % SWEEP_EVERY == SWEEP_EVERY - 1) {
+            for(int j = 0; j < SWEEP; ++j) r.push_back(entry(cold++));
+        }
+
+        auto rank = std::lower_bound(cdf.begin(), cdf.end(), u() * sum) - cdf.begin(); r.push_back(entries[std::min<size_t>(rank, ENTRIES - 1)]);
+    }
+
+    return r;
+}
+
+int main(int argc, char ** argv) {
+    vector<access_t> trace; if(argc > 1) {
+        std::ifstream in(argv[1]); for(access_t a; in >> a.key >> a.size >> a.cost;) trace.push_back(a);
+
+        ok(format("read {} accesses from {}", trace.size(), argv[1])) = !trace.empty();
+    }
+    else {
+        trace = synthetic(); print("synthetic trace of {} accesses\n", trace.size());
+    }
+
+    double total_bytes = 0; for(auto & a : trace) total_bytes += a.size;
+
+    print("cache MiB  policy    hit ratio  byte hit ratio  decompressed GB\n");
+
+    for(size_t capacity : {64, 256, 1024}) for(auto name : {"lru", "gdsf", "tinylfu"}) {
+        policy_cache<uint64_t, placeholder_t> cache {capacity << 20}; cache.set_policy(make_policy(name));
+
+        uint64_t hits = 0; double hit_bytes = 0, decompressed = 0; for(auto & a : trace) {
+            if(cache.get(a.key)) {
+                ++hits; hit_bytes += a.size; continue;
+            }
+
+            decompressed += a.cost > 1 ? a.cost : 0; cache.insert(a.key, placeholder_t {a.size}, a.cost);
+        }
+
+        print("{:9}  {:<8}  {:9.3f}  {:14.3f}  {:15.2f}\n", capacity, name, (double)hits / trace.size(), hit_bytes / total_bytes, decompressed / 1e9);
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include "stdafx.h"
+#include "../test/fuse_driver.h"
+
+#include "bench.h"
+
+// ls -l on a directory of 100k entries through the frontend's callbacks, in kernel-sized pages: with plain readdir the
+// kernel has to follow the listing with a lookup per child, with readdirplus the attributes come along in the pages of
+// a listing rendered once; the calls column counts the daemon calls a listing took (what the kernel caches of it is
+// not counted, a listing it still has costs none)
+//
+//   readdir [entries] [listings]
+int main(int argc, char ** argv) {
+    auto entries = argc > 1 ? atoi(argv[1]) : 100000; auto listings_n = argc > 2 ? atoi(argv[2]) : 5;
+
+    enum { PAGE_SIZE = 4096 };
+
+    auto fname = bench_name("readdir.zip"); zip_writer_t zip; for(int i = 0; i < entries; ++i) zip.add(format("big/file{:06}.txt", i));
+
+    ok(format("write {}", fname)) = zip.save(fname);
+
+    ok(format("open  {}", fname)) = $archive.open(fname);
+
+    auto dir = call(zmLookup, FUSE_ROOT_ID, "big").entry.ino; vector<listed_t> listed; bool good = true;
+
+    // one ls -l: seconds per listing and daemon calls per listing
+    auto measure = [&](bool plus, int n) {
+        auto before = calls.lookup + calls.readdir; auto t = timed([&] {
+            for(int i = 0; i < n; ++i) {
+                good = good && list_dir(dir, plus, PAGE_SIZE, listed) && listed.size() == (size_t)entries; if(plus) continue;
+
+                for(auto & l : listed) good = good && !call(zmLookup, dir, l.name.c_str()).err;
+            }
+        });
+
+        // opendir and releasedir each listing
+        return pair {t / n, (double)(calls.lookup + calls.readdir - before) / n + 2};
+    };
+
+    auto [plain, plain_calls] = measure(false, listings_n);
+
+    auto [first, first_calls] = measure(true, 1);
+
+    auto [rendered, rendered_calls] = measure(true, listings_n);
+
+    ok(format("list {} entries", entries)) = good;
+
+    print("readdir + lookups        {:8.1f} ms   {:7.0f} calls\n", plain * 1e3, plain_calls);
+    print("readdirplus, rendering   {:8.1f} ms   {:7.0f} calls\n", first * 1e3, first_calls);
+    print("readdirplus, rendered    {:8.1f} ms   {:7.0f} calls   {:.1f}x\n", rendered * 1e3, rendered_calls, plain / rendered);
+
+    return 0;
+}
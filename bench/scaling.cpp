@@ -0,0 +1,72 @@
+#include "stdafx.h"
+#include "archive.h"
+
+#include "bench.h"
+
+// parallel lookups and reads against the core, from 1 to 32 threads: how far the immutable index, the pinned cache
+// handles and the per-thread decoders let throughput grow with the threads; a small cache keeps the readers decoding,
+// a large one has them served from cached blocks
+//
+//   scaling [max threads] [seconds per measurement]
+int main(int argc, char ** argv) {
+    auto max_threads = argc > 1 ? atoi(argv[1]) : 32; auto seconds = argc > 2 ? atof(argv[2]) : 1.0;
+
+    enum { SMALL = 50000, LARGE = 16, LARGE_SIZE = 4 << 20, READ_SIZE = 64 << 10 };
+
+    auto fname = bench_name("scaling.zip"); zip_writer_t zip; vector<string> small, large; {
+        for(int i = 0; i < SMALL; ++i) zip.add(small.emplace_back(format("d{}/e{}/f{}.txt", i % 97, i % 13, i)), text(200 + i % 1000, i), i % 2);
+
+        for(int i = 0; i < LARGE; ++i) zip.add(large.emplace_back(format("large/f{}.bin", i)), text(LARGE_SIZE, ~i), true);
+    }
+
+    ok(format("write {}", fname)) = zip.save(fname);
+
+    archive_t a; ok(format("open  {}", fname)) = a.open(fname);
+
+    vector<int> large_nodes; for(auto & name : large) large_nodes.push_back(a.locate(name).index);
+
+    // runs op(thread, rng) on every thread until the time is up, returns operations per second
+    auto run = [&](int threads, auto && op) {
+        atomic<bool> stop {false}; atomic<uint64_t> done {0}; vector<thread> workers; for(int t = 0; t < threads; ++t) workers.emplace_back([&, t] {
+            uint32_t rng = 2654435761u * (t + 1); uint64_t n = 0; while(!stop.load(std::memory_order_relaxed)) {
+                rng = rng * 1103515245 + 12345; op(rng); ++n;
+            }
+
+            done += n;
+        });
+
+        this_thread::sleep_for(chrono::duration<double>(seconds)); stop = true; for(auto & w : workers) w.join();
+
+        return done / seconds;
+    };
+
+    auto lookup = [&](uint32_t rng) { if(!a.locate(small[rng % SMALL]).is_file()) exit(1); };
+
+    auto read = [&](uint32_t rng) {
+        thread_local string buf(READ_SIZE, 0); auto node = large_nodes[rng % LARGE]; auto offset = (uint64_t)(rng >> 8) * 4096 % (LARGE_SIZE - READ_SIZE);
+
+        auto f = a.open_file(node); auto good = a.read(*f, offset, buf.data(), buf.size()); a.close_file(f); if(!good) exit(1);
+    };
+
+    print("threads  lookups/s  x1     cached MB/s  x1     decoding MB/s  x1\n");
+
+    double base[3] {}; for(int threads = 1; threads <= max_threads; threads *= 2) {
+        auto lookups = run(threads, lookup);
+
+        // every block cached
+        a.cache.set_capacity(512 << 20); for(auto node : large_nodes) {
+            string all(LARGE_SIZE, 0); auto f = a.open_file(node); a.read(*f, 0, all.data(), all.size()); a.close_file(f);
+        }
+
+        a.drain(); auto cached = run(threads, read) * (double)READ_SIZE / 1e6;
+
+        // room for a fraction of the large entries, most reads decode
+        a.cache.set_capacity(16 << 20); auto decoding = run(threads, read) * (double)READ_SIZE / 1e6; a.drain();
+
+        if(threads == 1) base[0] = lookups, base[1] = cached, base[2] = decoding;
+
+        print("{:7}  {:9.0f}  {:4.1f}   {:11.0f}  {:4.1f}   {:13.0f}  {:4.1f}\n", threads, lookups, lookups / base[0], cached, cached / base[1], decoding, decoding / base[2]);
+    }
+
+    print("({} hardware threads)\n", thread::hardware_concurrency()); return 0;
+}
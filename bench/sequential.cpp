@@ -0,0 +1,69 @@
+#include "stdafx.h"
+#include "../test/fuse_driver.h"
+
+#include "bench.h"
+
+// sequential reads of a stored and a deflated entry through zmRead() in the kernel's 128 KiB requests, against the
+// copying path it replaced ($archive.read() into a buffer, fuse_reply_buf()); the deflated entry is read once with
+// the cache cold and once with every block cached, where zmRead() replies with the cache's pinned pages; the driver's
+// fuse_reply_data() copies what the kernel would splice, so the figures are the daemon's side of a read
+//
+//   sequential [entry MiB] [passes]
+int main(int argc, char ** argv) {
+    auto entry_size = (size_t)(argc > 1 ? atoi(argv[1]) : 64) << 20; auto passes = argc > 2 ? atoi(argv[2]) : 4;
+
+    enum { REQUEST_SIZE = 128 << 10 };
+
+    auto fname = bench_name("sequential.zip"); zip_writer_t zip; {
+        zip.add("stored.bin", text(entry_size, 1)); zip.add("deflated.bin", text(entry_size, 2), true);
+    }
+
+    ok(format("write {}", fname)) = zip.save(fname);
+
+    ok(format("open  {}", fname)) = $archive.open(fname);
+
+    // entries over a quarter of the capacity are streamed past the cache, this one has to stay cacheable
+    $archive.cache.set_capacity(entry_size * 8); bool good = true;
+
+    // one pass over the entry, every request replied to through reply
+    auto pass = [&](const char * name, auto && reply) {
+        fuse_file_info fi {}; fi.flags = O_RDONLY; auto ino = call(zmLookup, FUSE_ROOT_ID, name).entry.ino; fi = call(zmOpen, ino, &fi).fi;
+
+        for(size_t off = 0; off < entry_size; off += REQUEST_SIZE) {
+            auto r = call(reply, ino, REQUEST_SIZE, (off_t)off, &fi); good = good && !r.err && r.data.size() == std::min<size_t>(REQUEST_SIZE, entry_size - off);
+        }
+
+        call(zmRelease, ino, &fi);
+    };
+
+    auto copying = [](fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, fuse_file_info * fi) {
+        auto & file = *(file_t *)fi->fh; auto toread = std::min<uint64_t>(file.size - off, size);
+
+        buffer_t buffer(toread); if(!$archive.read(file, off, buffer.data(), toread)) {
+            fuse_reply_err(req, EIO); return;
+        }
+
+        fuse_reply_buf(req, (const char *)buffer.data(), toread);
+    };
+
+    // MB/s over passes, the cache emptied before each one if cold
+    auto measure = [&](const char * name, auto && reply, bool cold) {
+        double t = 0; for(int i = 0; i < passes; ++i) {
+            if(cold) $archive.cache.clear(); else pass(name, reply);
+
+            t += timed([&] { pass(name, reply); }); $archive.drain();
+        }
+
+        return passes * (double)entry_size / t / 1e6;
+    };
+
+    print("entry               zmRead MB/s   copying MB/s\n");
+
+    for(auto [label, name, cold] : {tuple {"stored", "stored.bin", false}, {"deflated, cold", "deflated.bin", true}, {"deflated, cached", "deflated.bin", false}}) {
+        auto replied = measure(name, zmRead, cold), copied = measure(name, copying, cold);
+
+        print("{:<18}  {:11.0f}   {:12.0f}\n", label, replied, copied);
+    }
+
+    ok("read every request") = good; return 0;
+}
@@ -0,0 +1,63 @@
+#include "stdafx.h"
+#include "archive.h"
+
+#include "bench.h"
+
+// stat and lookup throughput on a synthetic archive of a million entries: through miniz's reader, as $archive.stat()
+// and locate() did before the index (mz_zip_reader_file_stat() parses the central directory header and calls
+// mktime() each time, mz_zip_reader_locate_file() compares names in the central directory), and through the index
+// the core builds at open()
+//
+//   stat [entries] [operations]
+int main(int argc, char ** argv) {
+    auto entries = argc > 1 ? atoi(argv[1]) : 1000000; auto operations = argc > 2 ? atoi(argv[2]) : 1000000;
+
+    auto fname = bench_name("stat.zip"); zip_writer_t zip; vector<string> names; for(int i = 0; i < entries; ++i) {
+        zip.add(names.emplace_back(format("d{}/e{}/f{}.txt", i % 1000, i % 7, i)));
+    }
+
+    ok(format("write {} entries", entries)) = zip.save(fname);
+
+    mapping_t m; mz_zip_archive zipf {}; auto miniz_open = timed([&] { ok("open miniz") = m.map(fname) && mz_zip_reader_init_mem(&zipf, m.data(), m.size(), 0); });
+
+    archive_t a; auto index_open = timed([&] { ok("open index") = a.open(fname); });
+
+    // what the callbacks got from a stat, the path copied out
+    struct stat_t {
+        string fpath; uint64_t size; int64_t mtime; bool dir;
+    };
+
+    uint64_t sum = 0; auto rng = 12345u; auto next = [&] { rng = rng * 1103515245 + 12345; return (rng >> 4) % entries; };
+
+    auto miniz_stat = timed([&] {
+        for(int i = 0; i < operations; ++i) {
+            mz_zip_archive_file_stat st; mz_zip_reader_file_stat(&zipf, next(), &st); stat_t r {st.m_filename, st.m_uncomp_size, st.m_time, (bool)st.m_is_directory};
+
+            sum += r.size + r.mtime + r.fpath.size();
+        }
+    });
+
+    vector<int> nodes; for(auto & name : names) nodes.push_back(a.locate(name).index);
+
+    auto index_stat = timed([&] {
+        for(int i = 0; i < operations; ++i) {
+            auto st = a.stat(nodes[next()]); sum += st.size + st.mtime + st.fpath.size();
+        }
+    });
+
+    auto lookups = std::min(operations, 100000); auto miniz_lookup = timed([&] {
+        for(int i = 0; i < lookups; ++i) {
+            auto findex = mz_zip_reader_locate_file(&zipf, names[next()].c_str(), nullptr, 0); mz_zip_archive_file_stat st; mz_zip_reader_file_stat(&zipf, findex, &st); sum += st.m_uncomp_size;
+        }
+    });
+
+    auto index_lookup = timed([&] {
+        for(int i = 0; i < lookups; ++i) sum += a.stat(a.locate(names[next()]).index).size;
+    });
+
+    print("open          miniz {:8.1f} ms   index {:8.1f} ms (no sidecar)\n", miniz_open * 1e3, index_open * 1e3);
+    print("stat          miniz {:8.1f} ns   index {:8.1f} ns   {:.1f}x\n", miniz_stat / operations * 1e9, index_stat / operations * 1e9, miniz_stat / index_stat);
+    print("lookup + stat miniz {:8.1f} ns   index {:8.1f} ns   {:.1f}x\n", miniz_lookup / lookups * 1e9, index_lookup / lookups * 1e9, miniz_lookup / index_lookup);
+
+    mz_zip_reader_end(&zipf); return sum == 42;
+}
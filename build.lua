@@ -3,7 +3,10 @@ local path = _G['path']
 local public = _G['public']
 local files_in = _G['files_in']
 
-ninja.toolchain = 'clangcl'
+-- windows builds the dokan frontend with clang-cl, everything else the fuse one
+local windows = package.config:sub(1, 1) == '\\'
+
+ninja.toolchain = windows and 'clangcl' or 'clang'
 
 local debug = (function()
     for _, x in ipairs(arg) do
@@ -16,29 +19,202 @@ end)()
 
 ninja.build_dir(debug and 'debug' or 'release')
 
-local cc = ninja.target('cc')
-    :type('phony')
-    :define(public {
-        debug and 'DEBUG' or 'NDEBUG', '_CRT_SECURE_NO_WARNINGS', '_CRT_NONSTDC_NO_WARNINGS', '_SILENCE_ALL_CXX17_DEPRECATION_WARNINGS',
-        '_WIN32', '_WIN32_WINNT=0x0601', 'NOMINMAX'
-    })
-    :c_flags(public { std = 'c11' })
-    :cx_flags(public { '/arch:AVX', '/Z7', '/GS-', debug and '/Od' or '/O2' })
-    :cx_flags(public { '-Wno-unused-value', '-Wno-microsoft-cast', '-Wno-int-to-pointer-cast', '-Wno-invalid-noreturn', '-Wno-microsoft-exception-spec' })
-    :cxx_flags(public { std = 'c++latest', '/EHsc' })
-    :ld_flags(public { '/DEBUG', '/OPT:REF' })
-    :include_dir(public { 'include', 'w:/projects/mimalloc/deps/mimalloc/include' })
-    :lib_dir(public { 'w:/projects/mimalloc/release' })
-    :lib(public { 'mimalloc.lib', 'advapi32.lib', 'user32.lib', 'shell32.lib' })
-
-local zipmount = ninja.target('zipmount')
-    :type('binary')
-    :deps(cc)
-    :cxx_pch('stdafx.h')
-    :define('_ATL_NO_COM_SUPPORT'):include_dir('atl/include'):lib_dir('atl/lib/x64')
-    :include_dir('dokan/include/dokan'):lib_dir('dokan/lib'):lib('dokan2.lib')
-    :src('miniz.c')
-    :src('zipmount.cpp')
+if windows then
+    local cc = ninja.target('cc')
+        :type('phony')
+        :define(public {
+            debug and 'DEBUG' or 'NDEBUG', '_CRT_SECURE_NO_WARNINGS', '_CRT_NONSTDC_NO_WARNINGS', '_SILENCE_ALL_CXX17_DEPRECATION_WARNINGS',
+            '_WIN32', '_WIN32_WINNT=0x0601', 'NOMINMAX'
+        })
+        :c_flags(public { std = 'c11' })
+        :cx_flags(public { '/arch:AVX', '/Z7', '/GS-', debug and '/Od' or '/O2' })
+        :cx_flags(public { '-Wno-unused-value', '-Wno-microsoft-cast', '-Wno-int-to-pointer-cast', '-Wno-invalid-noreturn', '-Wno-microsoft-exception-spec' })
+        :cxx_flags(public { std = 'c++latest', '/EHsc' })
+        :ld_flags(public { '/DEBUG', '/OPT:REF' })
+        :include_dir(public { 'include', 'w:/projects/mimalloc/deps/mimalloc/include' })
+        :lib_dir(public { 'w:/projects/mimalloc/release' })
+        :lib(public { 'mimalloc.lib', 'advapi32.lib', 'user32.lib', 'shell32.lib' })
+
+    local zipmount = ninja.target('zipmount')
+        :type('binary')
+        :deps(cc)
+        :cxx_pch('stdafx.h')
+        :define('_ATL_NO_COM_SUPPORT'):include_dir('atl/include'):lib_dir('atl/lib/x64')
+        :include_dir('dokan/include/dokan'):lib_dir('dokan/lib'):lib('dokan2.lib')
+        :define({ 'USE_EXTERNAL_MZCRC', 'MINIZ_NO_ARCHIVE_APIS' })
+        :src('miniz.c')
+        :src('crc32.cpp')
+        :src('inflate.cpp')
+        :src('zipmount.cpp')
+
+    -- zipmount.h for programs that read archives in process, without a mount
+    local libzipmount = ninja.target('libzipmount')
+        :type('static')
+        :deps(cc)
+        :cxx_pch('stdafx.h')
+        :define('_ATL_NO_COM_SUPPORT'):include_dir('atl/include')
+        :include_dir('dokan/include/dokan')
+        :define({ 'USE_EXTERNAL_MZCRC', 'MINIZ_NO_ARCHIVE_APIS', 'MINIZ_NO_DEFLATE_APIS', 'MINIZ_NO_ZLIB_APIS', 'ZIPMOUNT_LIBRARY' })
+        :src('miniz_lib.c')
+        :src('crc32.cpp')
+        :src('inflate.cpp')
+        :src('zipmount_lib.cpp')
+else
+    local cc = ninja.target('cc')
+        :type('phony')
+        :define(public { debug and 'DEBUG' or 'NDEBUG', '_FILE_OFFSET_BITS=64' })
+        :c_flags(public { std = 'c11' })
+        :cx_flags(public { '-g', debug and '-O0' or '-O2' })
+        :cxx_flags(public { std = 'c++23' })
+        :include_dir(public { 'include', '/usr/include/fuse3' })
+        :lib(public { 'mimalloc', 'pthread' })
+
+    local zipmount = ninja.target('zipmount')
+        :type('binary')
+        :deps(cc)
+        :cxx_pch('stdafx.h')
+        :lib('fuse3')
+        :define({ 'USE_EXTERNAL_MZCRC', 'MINIZ_NO_ARCHIVE_APIS' })
+        :src('miniz.c')
+        :src('crc32.cpp')
+        :src('inflate.cpp')
+        :src('zipmount_fuse.cpp')
+
+    -- zipmount.h for programs that read archives in process, without a mount
+    local libzipmount = ninja.target('libzipmount')
+        :type('static')
+        :deps(cc)
+        :cxx_pch('stdafx.h')
+        :define({ 'USE_EXTERNAL_MZCRC', 'MINIZ_NO_ARCHIVE_APIS', 'MINIZ_NO_DEFLATE_APIS', 'MINIZ_NO_ZLIB_APIS', 'ZIPMOUNT_LIBRARY' })
+        :src('miniz_lib.c')
+        :src('crc32.cpp')
+        :src('inflate.cpp')
+        :src('zipmount_lib.cpp')
+
+    -- the frontend's callbacks run in process against libfuse's reply functions stubbed out, no mount needed
+    local fuse_test = ninja.target('fuse_test')
+        :type('binary')
+        :deps(cc)
+        :cxx_pch('stdafx.h')
+        :include_dir('.')
+        :lib('fuse3')
+        :define({ 'USE_EXTERNAL_MZCRC', 'MINIZ_NO_ARCHIVE_APIS' })
+        :src('miniz.c')
+        :src('crc32.cpp')
+        :src('inflate.cpp')
+        :src('test/fuse_test.cpp')
+
+    -- the archive core against well-formed and malformed archives written by the test
+    local archive_test = ninja.target('archive_test')
+        :type('binary')
+        :deps(cc)
+        :cxx_pch('stdafx.h')
+        :include_dir('.')
+        :define({ 'USE_EXTERNAL_MZCRC', 'MINIZ_NO_ARCHIVE_APIS' })
+        :src('miniz.c')
+        :src('crc32.cpp')
+        :src('inflate.cpp')
+        :src('test/archive_test.cpp')
+
+    -- parallel lookups and reads against the core from 1 to 32 threads
+    local scaling = ninja.target('scaling')
+        :type('binary')
+        :deps(cc)
+        :cxx_pch('stdafx.h')
+        :include_dir('.')
+        :define({ 'USE_EXTERNAL_MZCRC', 'MINIZ_NO_ARCHIVE_APIS' })
+        :src('miniz.c')
+        :src('crc32.cpp')
+        :src('inflate.cpp')
+        :src('bench/scaling.cpp')
+
+    -- peak rss and page faults of decoding into zero-filled strings and into pooled buffers
+    local memory = ninja.target('memory')
+        :type('binary')
+        :deps(cc)
+        :cxx_pch('stdafx.h')
+        :include_dir('.')
+        :define({ 'USE_EXTERNAL_MZCRC', 'MINIZ_NO_ARCHIVE_APIS' })
+        :src('miniz.c')
+        :src('crc32.cpp')
+        :src('inflate.cpp')
+        :src('bench/memory.cpp')
+
+    -- stat and lookup through miniz's reader against the index, miniz keeps its archive apis here (and needs FALSE
+    -- off windows for them)
+    local stat = ninja.target('stat')
+        :type('binary')
+        :deps(cc)
+        :cxx_pch('stdafx.h')
+        :include_dir('.')
+        :define({ 'USE_EXTERNAL_MZCRC', 'FALSE=0' })
+        :src('miniz.c')
+        :src('crc32.cpp')
+        :src('inflate.cpp')
+        :src('bench/stat.cpp')
+
+    -- the cost of a cache hit as the value grows to 64 MiB, against copying it out
+    local hit = ninja.target('hit')
+        :type('binary')
+        :deps(cc)
+        :cxx_pch('stdafx.h')
+        :include_dir('.')
+        :define({ 'USE_EXTERNAL_MZCRC', 'MINIZ_NO_ARCHIVE_APIS' })
+        :src('miniz.c')
+        :src('crc32.cpp')
+        :src('inflate.cpp')
+        :src('bench/hit.cpp')
+
+    -- crc32 throughput of the dispatched mz_crc32() against miniz's byte-at-a-time table
+    local crc = ninja.target('crc')
+        :type('binary')
+        :deps(cc)
+        :cxx_pch('stdafx.h')
+        :include_dir('.')
+        :define({ 'USE_EXTERNAL_MZCRC', 'MINIZ_NO_ARCHIVE_APIS' })
+        :src('miniz.c')
+        :src('crc32.cpp')
+        :src('inflate.cpp')
+        :src('bench/crc.cpp')
+
+    -- ls -l on a 100k-entry directory through readdir and lookups against readdirplus, in time and daemon calls
+    local readdir = ninja.target('readdir')
+        :type('binary')
+        :deps(cc)
+        :cxx_pch('stdafx.h')
+        :include_dir('.')
+        :lib('fuse3')
+        :define({ 'USE_EXTERNAL_MZCRC', 'MINIZ_NO_ARCHIVE_APIS' })
+        :src('miniz.c')
+        :src('crc32.cpp')
+        :src('inflate.cpp')
+        :src('bench/readdir.cpp')
+
+    -- sequential reads of stored and deflated entries through zmRead() against copying them into the reply
+    local sequential = ninja.target('sequential')
+        :type('binary')
+        :deps(cc)
+        :cxx_pch('stdafx.h')
+        :include_dir('.')
+        :lib('fuse3')
+        :define({ 'USE_EXTERNAL_MZCRC', 'MINIZ_NO_ARCHIVE_APIS' })
+        :src('miniz.c')
+        :src('crc32.cpp')
+        :src('inflate.cpp')
+        :src('bench/sequential.cpp')
+
+    -- the eviction policies over a trace, hit ratio and bytes decompressed per policy and cache size
+    local policies = ninja.target('policies')
+        :type('binary')
+        :deps(cc)
+        :cxx_pch('stdafx.h')
+        :include_dir('.')
+        :define({ 'USE_EXTERNAL_MZCRC', 'MINIZ_NO_ARCHIVE_APIS' })
+        :src('miniz.c')
+        :src('crc32.cpp')
+        :src('inflate.cpp')
+        :src('bench/policies.cpp')
+end
 
 ninja.watch(
     '.', { '.', '*.cpp', '*.c', '*.h' }, function(fpath)
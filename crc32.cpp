@@ -0,0 +1,183 @@
+#include "stdafx.h"
+
+// mz_crc32() for miniz built with USE_EXTERNAL_MZCRC: carry-less multiply folding where the cpu has it, the
+// armv8 crc instructions on arm64 cpus that have them and slicing-by-16 everywhere else; same contract as miniz,
+// crc is the previous result (0 to start) and the return value is not inverted
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#if defined(__clang__) || defined(__GNUC__)
+#define CRC_CLMUL_TARGET __attribute__((target("pclmul,sse4.1")))
+#else
+#define CRC_CLMUL_TARGET
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <arm_acle.h>
+#endif
+#if defined(__linux__)
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+// the crc extension is optional before armv8.1, a build for plain armv8-a still uses it where the cpu has it
+#if defined(__clang__)
+#define CRC_ARM_TARGET __attribute__((target("crc")))
+#elif defined(__GNUC__)
+#define CRC_ARM_TARGET __attribute__((target("+crc")))
+#else
+#define CRC_ARM_TARGET
+#endif
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace {
+    // the reflected crc-32 table, followed by 15 more that each advance it by one more zero byte
+    constexpr auto slices = [] {
+        std::array<std::array<uint32_t, 256>, 16> t {}; for(uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i; for(int k = 0; k < 8; ++k) c = (c >> 1) ^ (0xEDB88320u & (0u - (c & 1)));
+
+            t[0][i] = c;
+        }
+
+        for(uint32_t i = 0; i < 256; ++i) {
+            for(int s = 1; s < 16; ++s) t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFF];
+        }
+
+        return t;
+    }();
+
+    // c is the inverted running crc
+    uint32_t crc_slice16(uint32_t c, const uint8_t * p, size_t n) {
+        auto & t = slices; while(n >= 16) {
+            uint32_t a, b, d, e; memcpy(&a, p, 4); memcpy(&b, p + 4, 4); memcpy(&d, p + 8, 4); memcpy(&e, p + 12, 4); a ^= c;
+
+            c = t[15][a & 0xFF] ^ t[14][(a >> 8) & 0xFF] ^ t[13][(a >> 16) & 0xFF] ^ t[12][a >> 24] ^
+                t[11][b & 0xFF] ^ t[10][(b >> 8) & 0xFF] ^ t[9][(b >> 16) & 0xFF] ^ t[8][b >> 24] ^
+                t[7][d & 0xFF] ^ t[6][(d >> 8) & 0xFF] ^ t[5][(d >> 16) & 0xFF] ^ t[4][d >> 24] ^
+                t[3][e & 0xFF] ^ t[2][(e >> 8) & 0xFF] ^ t[1][(e >> 16) & 0xFF] ^ t[0][e >> 24];
+
+            p += 16; n -= 16;
+        }
+
+        while(n--) c = (c >> 8) ^ t[0][(c ^ *p++) & 0xFF];
+
+        return c;
+    }
+
+#if defined(_M_X64) || defined(__x86_64__)
+    bool has_clmul() {
+#if defined(_MSC_VER)
+        int r[4]; __cpuid(r, 1); return (r[2] & (1 << 1)) && (r[2] & (1 << 19));
+#else
+        unsigned a, b, c, d; return __get_cpuid(1, &a, &b, &c, &d) && (c & bit_PCLMUL) && (c & bit_SSE4_1);
+#endif
+    }
+
+    // folds four 128-bit lanes at a time, then one, then reduces to 32 bits (intel's "fast crc computation
+    // using pclmulqdq"); n is a multiple of 16 and at least 64, c is the inverted running crc
+    CRC_CLMUL_TARGET uint32_t crc_clmul(uint32_t c, const uint8_t * p, size_t n) {
+        alignas(16) static const uint64_t k1k2[] {0x0154442bd4, 0x01c6e41596}, k3k4[] {0x01751997d0, 0x00ccaa009e}, k5k0[] {0x0163cd6124, 0}, poly[] {0x01db710641, 0x01f7011641};
+
+        auto load = [](const uint8_t * q) { return _mm_loadu_si128((const __m128i *)q); };
+
+        __m128i x1 = load(p), x2 = load(p + 16), x3 = load(p + 32), x4 = load(p + 48), x0 = _mm_load_si128((const __m128i *)k1k2), x5, x6, x7, x8;
+
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)c)); p += 64; n -= 64;
+
+        while(n >= 64) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00); x6 = _mm_clmulepi64_si128(x2, x0, 0x00); x7 = _mm_clmulepi64_si128(x3, x0, 0x00); x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11); x2 = _mm_clmulepi64_si128(x2, x0, 0x11); x3 = _mm_clmulepi64_si128(x3, x0, 0x11); x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), load(p)); x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), load(p + 16));
+            x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), load(p + 32)); x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), load(p + 48));
+
+            p += 64; n -= 64;
+        }
+
+        // fold the four lanes into one
+        x0 = _mm_load_si128((const __m128i *)k3k4); for(auto x : {x2, x3, x4}) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00); x1 = _mm_clmulepi64_si128(x1, x0, 0x11); x1 = _mm_xor_si128(_mm_xor_si128(x1, x), x5);
+        }
+
+        while(n >= 16) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00); x1 = _mm_clmulepi64_si128(x1, x0, 0x11); x1 = _mm_xor_si128(_mm_xor_si128(x1, load(p)), x5);
+
+            p += 16; n -= 16;
+        }
+
+        // 128 to 64 bits
+        x2 = _mm_clmulepi64_si128(x1, x0, 0x10); x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+        x0 = _mm_loadl_epi64((const __m128i *)k5k0); x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, x3), x0, 0x00), x2);
+
+        // barrett reduction to 32 bits
+        x0 = _mm_load_si128((const __m128i *)poly);
+        x2 = _mm_and_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, x3), x0, 0x10), x3);
+        x1 = _mm_xor_si128(x1, _mm_clmulepi64_si128(x2, x0, 0x00));
+
+        return (uint32_t)_mm_extract_epi32(x1, 1);
+    }
+
+    const bool clmul = has_clmul();
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    bool has_crc() {
+#if defined(__ARM_FEATURE_CRC32)
+        return true;
+#elif defined(_WIN32)
+        return IsProcessorFeaturePresent(PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE);
+#elif defined(__linux__)
+        return getauxval(AT_HWCAP) & HWCAP_CRC32;
+#elif defined(__APPLE__)
+        // every apple arm64 cpu has them
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // c is the inverted running crc
+    CRC_ARM_TARGET uint32_t crc_arm(uint32_t c, const uint8_t * p, size_t n) {
+        for(; n >= 8; p += 8, n -= 8) {
+            uint64_t v; memcpy(&v, p, 8); c = __crc32d(c, v);
+        }
+
+        for(; n; --n) c = __crc32b(c, *p++);
+
+        return c;
+    }
+
+    const bool crc_insns = has_crc();
+#endif
+}
+
+extern "C" mz_ulong mz_crc32(mz_ulong crc, const mz_uint8 * ptr, size_t buf_len) {
+    if(!ptr) return MZ_CRC32_INIT;
+
+    uint32_t c = ~(uint32_t)crc;
+
+#if defined(_M_X64) || defined(__x86_64__)
+    if(clmul && buf_len >= 64) {
+        auto n = buf_len & ~(size_t)15; c = crc_clmul(c, ptr, n); ptr += n; buf_len -= n;
+    }
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    if(crc_insns) return ~crc_arm(c, ptr, buf_len);
+#elif defined(__ARM_FEATURE_CRC32)
+    for(; buf_len >= 8; ptr += 8, buf_len -= 8) {
+        uint64_t v; memcpy(&v, ptr, 8); c = __crc32d(c, v);
+    }
+
+    for(; buf_len; --buf_len) c = __crc32b(c, *ptr++);
+#endif
+
+    return ~crc_slice16(c, ptr, buf_len);
+}
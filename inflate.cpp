@@ -0,0 +1,245 @@
+#include "stdafx.h"
+#include "inflate.h"
+
+// a one-shot inflater for when both buffers are fully available: no resumable state machine, a 64-bit bit buffer
+// refilled a word at a time, table entries that carry the length/distance base and extra bit count so a symbol
+// decodes in one lookup, back-to-back literals without refills and word-wide match copies
+namespace {
+    enum { LIT, LEN, EOB, DIST, SUB, BAD };
+
+    enum { LITLEN_BITS = 11, DIST_BITS = 8, CODELEN_BITS = 7 };
+
+    // an entry is value << 16 | extra bits << 8 | kind << 4 | code length, subtable entries keep the subtable offset
+    // in value and its index width in extra
+    constexpr uint32_t entry(uint32_t value, uint32_t extra, uint32_t kind) { return value << 16 | extra << 8 | kind << 4; }
+
+    constexpr uint16_t len_base[] {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    constexpr uint8_t len_extra[] {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    constexpr uint16_t dist_base[] {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    constexpr uint8_t dist_extra[] {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    constexpr uint8_t codelen_order[] {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+    uint32_t litlen_entry(int sym) {
+        if(sym < 256) return entry(sym, 0, LIT); if(sym == 256) return entry(0, 0, EOB);
+
+        return sym < 286 ? entry(len_base[sym - 257], len_extra[sym - 257], LEN) : entry(0, 0, BAD);
+    }
+
+    uint32_t dist_entry(int sym) { return sym < 30 ? entry(dist_base[sym], dist_extra[sym], DIST) : entry(0, 0, BAD); }
+
+    uint32_t codelen_entry(int sym) { return entry(sym, 0, LIT); }
+
+    // primary table of 2^bits entries followed by subtables for the longer codes, at most 16 entries per prefix
+    template<int BITS, int SYMBOLS>
+    struct table_t {
+        uint32_t e[(1 << BITS) + SYMBOLS * (1 << (15 - BITS))];
+
+        // builds the canonical code given by lens, false if it is over-subscribed; unused slots of an incomplete
+        // code decode as BAD
+        bool build(const uint8_t * lens, int n, uint32_t (*make)(int)) {
+            int count[16] {}; for(int i = 0; i < n; ++i) count[lens[i]]++; count[0] = 0;
+
+            int left = 1; for(int len = 1; len < 16; ++len) {
+                left = (left << 1) - count[len]; if(left < 0) return false;
+            }
+
+            uint32_t next[16] {}; for(uint32_t len = 1, code = 0; len < 16; ++len) {
+                code = (code + count[len - 1]) << 1; next[len] = code;
+            }
+
+            uint16_t rev[SYMBOLS]; uint8_t sub_bits[1 << BITS] {}; for(int i = 0; i < n; ++i) {
+                if(!lens[i]) continue;
+
+                uint32_t c = next[lens[i]]++, r = 0; for(int k = 0; k < lens[i]; ++k) r = r << 1 | (c >> k & 1); rev[i] = (uint16_t)r;
+
+                if(lens[i] > BITS) {
+                    auto & b = sub_bits[r & ((1 << BITS) - 1)]; b = std::max<uint8_t>(b, lens[i] - BITS);
+                }
+            }
+
+            std::fill(e, e + (1 << BITS), entry(0, 0, BAD)); uint32_t end = 1 << BITS; for(uint32_t p = 0; p < (1u << BITS); ++p) {
+                if(!sub_bits[p]) continue;
+
+                e[p] = entry(end, sub_bits[p], SUB) | BITS; std::fill(e + end, e + end + (1 << sub_bits[p]), entry(0, 0, BAD)); end += 1 << sub_bits[p];
+            }
+
+            for(int i = 0; i < n; ++i) {
+                auto len = lens[i]; if(!len) continue;
+
+                auto v = make(i) | len; if(len <= BITS) {
+                    for(uint32_t j = rev[i]; j < (1u << BITS); j += 1u << len) e[j] = v;
+                }
+                else {
+                    auto s = e[rev[i] & ((1 << BITS) - 1)]; auto base = s >> 16, width = (s >> 8) & 0xFF;
+                    for(uint32_t j = rev[i] >> BITS; j < (1u << width); j += 1u << (len - BITS)) e[base + j] = v;
+                }
+            }
+
+            return true;
+        }
+
+        uint32_t lookup(uint64_t bits) const {
+            auto v = e[bits & ((1 << BITS) - 1)]; if(((v >> 4) & 0xF) == SUB) {
+                v = e[(v >> 16) + ((bits >> BITS) & ((1u << ((v >> 8) & 0xFF)) - 1))];
+            }
+
+            return v;
+        }
+    };
+
+    struct inflater_t {
+        const uint8_t * in, * in_end; uint8_t * out, * out_begin, * out_end; uint64_t bitbuf {0}; uint32_t bitsleft {0}, overrun {0};
+
+        table_t<LITLEN_BITS, 288> litlen; table_t<DIST_BITS, 32> dist; table_t<CODELEN_BITS, 19> codelen;
+
+        // tops the bit buffer up to at least 56 bits, past the end of the input it shifts in zero bytes and counts them
+        void refill() {
+            if(in_end - in >= 8) {
+                uint64_t w; memcpy(&w, in, 8); bitbuf |= w << bitsleft; in += (63 - bitsleft) >> 3; bitsleft |= 56; return;
+            }
+
+            while(bitsleft <= 56) {
+                if(in < in_end) bitbuf |= (uint64_t)*in++ << bitsleft; else ++overrun; bitsleft += 8;
+            }
+        }
+
+        uint32_t bits(uint32_t n) const { return (uint32_t)(bitbuf & ((1ull << n) - 1)); }
+
+        void consume(uint32_t n) { bitbuf >>= n; bitsleft -= n; }
+
+        // bits have to be refilled by the caller, n <= 32
+        uint32_t take(uint32_t n) { auto r = bits(n); consume(n); return r; }
+
+        bool stored() {
+            // whole bytes still in the bit buffer go back to the input
+            consume(bitsleft & 7); auto back = bitsleft >> 3; if(overrun > back) return false;
+
+            in -= back - overrun; bitbuf = 0; bitsleft = overrun = 0;
+
+            if(in_end - in < 4) return false;
+
+            uint32_t len = in[0] | in[1] << 8, nlen = in[2] | in[3] << 8; in += 4; if((len ^ 0xFFFF) != nlen) return false;
+
+            if((size_t)(in_end - in) < len || (size_t)(out_end - out) < len) return false;
+
+            memcpy(out, in, len); in += len; out += len; return true;
+        }
+
+        bool dynamic_tables() {
+            refill(); uint32_t hlit = take(5) + 257, hdist = take(5) + 1, hclen = take(4) + 4; if(hlit > 286 || hdist > 30) return false;
+
+            uint8_t cl[19] {}; for(uint32_t i = 0; i < hclen; ++i) {
+                refill(); cl[codelen_order[i]] = (uint8_t)take(3);
+            }
+
+            if(!codelen.build(cl, 19, codelen_entry)) return false;
+
+            uint8_t lens[286 + 30]; for(uint32_t i = 0; i < hlit + hdist;) {
+                refill(); auto e = codelen.lookup(bitbuf); if(((e >> 4) & 0xF) == BAD) return false; consume(e & 0xF);
+
+                uint32_t sym = e >> 16, repeat, value = 0; if(sym < 16) {
+                    lens[i++] = (uint8_t)sym; continue;
+                }
+
+                if(sym == 16) {
+                    if(!i) return false; value = lens[i - 1]; repeat = 3 + take(2);
+                }
+                else {
+                    repeat = sym == 17 ? 3 + take(3) : 11 + take(7);
+                }
+
+                if(i + repeat > hlit + hdist) return false;
+
+                std::fill(lens + i, lens + i + repeat, (uint8_t)value); i += repeat;
+            }
+
+            if(!lens[256]) return false;
+
+            return litlen.build(lens, hlit, litlen_entry) && dist.build(lens + hlit, hdist, dist_entry);
+        }
+
+        bool fixed_tables() {
+            uint8_t lens[288 + 32]; {
+                std::fill(lens, lens + 144, 8); std::fill(lens + 144, lens + 256, 9); std::fill(lens + 256, lens + 280, 7); std::fill(lens + 280, lens + 288, 8);
+                std::fill(lens + 288, lens + 320, 5);
+            }
+
+            return litlen.build(lens, 288, litlen_entry) && dist.build(lens + 288, 32, dist_entry);
+        }
+
+        // copies a match, word-wide where the distance allows it and the output has room to overshoot
+        void copy(uint32_t length, uint32_t distance) {
+            auto src = out - distance, end = out + length; if(distance >= 8 && (size_t)(out_end - end) >= 16) {
+                if(distance >= 16) {
+                    do { memcpy(out, src, 16); out += 16; src += 16; } while(out < end);
+                }
+                else {
+                    do { memcpy(out, src, 8); out += 8; src += 8; } while(out < end);
+                }
+
+                out = end;
+            }
+            else if(distance == 1) {
+                memset(out, *src, length); out = end;
+            }
+            else {
+                while(out < end) *out++ = *src++;
+            }
+        }
+
+        bool block() {
+            for(;;) {
+                refill(); auto e = litlen.lookup(bitbuf); consume(e & 0xF);
+
+                auto kind = (e >> 4) & 0xF; if(kind == LIT) {
+                    if(out == out_end) return false; *out++ = (uint8_t)(e >> 16);
+
+                    // at least 41 bits are left, enough for another literal
+                    e = litlen.lookup(bitbuf); if(((e >> 4) & 0xF) == LIT) {
+                        consume(e & 0xF); if(out == out_end) return false; *out++ = (uint8_t)(e >> 16);
+                    }
+
+                    continue;
+                }
+
+                if(kind == EOB) return true; if(kind != LEN) return false;
+
+                // length extra bits (5) plus the distance code (15) and its extra bits (13) fit in what is left
+                uint32_t length = (e >> 16) + take((e >> 8) & 0xFF); if(bitsleft < 56 - 20) refill();
+
+                auto d = dist.lookup(bitbuf); if(((d >> 4) & 0xF) != DIST) return false; consume(d & 0xF);
+
+                uint32_t distance = (d >> 16) + take((d >> 8) & 0xFF);
+
+                if(distance > (size_t)(out - out_begin) || length > (size_t)(out_end - out)) return false;
+
+                copy(length, distance);
+            }
+        }
+
+        bool run() {
+            for(bool last = false; !last;) {
+                refill(); last = take(1); auto type = take(2);
+
+                switch(type) {
+                    case 0: if(!stored()) return false; break;
+                    case 1: if(!fixed_tables() || !block()) return false; break;
+                    case 2: if(!dynamic_tables() || !block()) return false; break;
+                    default: return false;
+                }
+            }
+
+            // the stream may not have needed more than the input held
+            return out == out_end && overrun <= bitsleft / 8;
+        }
+    };
+}
+
+bool inflate_fast(const uint8_t * src, size_t src_size, uint8_t * dst, size_t dst_size) {
+    // the tables make it large, each thread keeps one around
+    thread_local auto s = std::make_unique<inflater_t>(); {
+        s->in = src; s->in_end = src + src_size; s->out = s->out_begin = dst; s->out_end = dst + dst_size; s->bitbuf = 0; s->bitsleft = s->overrun = 0;
+    }
+
+    return s->run();
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// decodes a raw deflate stream that is entirely in memory into a buffer of exactly its decompressed size; false on
+// corrupt input or if the output does not come out at dst_size bytes
+bool inflate_fast(const uint8_t * src, size_t src_size, uint8_t * dst, size_t dst_size);
@@ -0,0 +1,3 @@
+// miniz as the library builds it, under the names miniz_prefix.h gives it
+#include "miniz_prefix.h"
+#include "miniz.c"
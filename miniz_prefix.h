@@ -0,0 +1,19 @@
+#pragma once
+
+// the library is linked into programs that may well carry a miniz (or zlib-alike) of their own, so in its build
+// every external name of miniz, and of the crc32 and inflate it is built with, gets a prefix of ours; included
+// ahead of miniz.h wherever the library builds
+#define miniz_def_alloc_func zipmount_miniz_def_alloc_func
+#define miniz_def_free_func zipmount_miniz_def_free_func
+#define miniz_def_realloc_func zipmount_miniz_def_realloc_func
+#define mz_adler32 zipmount_mz_adler32
+#define mz_crc32 zipmount_mz_crc32
+#define mz_free zipmount_mz_free
+#define mz_version zipmount_mz_version
+#define tinfl_decompress zipmount_tinfl_decompress
+#define tinfl_decompress_mem_to_callback zipmount_tinfl_decompress_mem_to_callback
+#define tinfl_decompress_mem_to_heap zipmount_tinfl_decompress_mem_to_heap
+#define tinfl_decompress_mem_to_mem zipmount_tinfl_decompress_mem_to_mem
+#define tinfl_decompressor_alloc zipmount_tinfl_decompressor_alloc
+#define tinfl_decompressor_free zipmount_tinfl_decompressor_free
+#define inflate_fast zipmount_inflate_fast
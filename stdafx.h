@@ -1,13 +1,37 @@
 #pragma once
 
+#ifdef _WIN32
 #include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include <type_traits>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <numeric>
+#include <cmath>
+#include <thread>
+#include <bit>
 #include <list>
+#include <deque>
+#include <functional>
 #include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <span>
+#include <fstream>
 #include <filesystem>
 #include <chrono>
 #include <format>
@@ -15,8 +39,16 @@
 
 #include "structopt.hpp"
 #include "mimalloc.h"
+#ifdef ZIPMOUNT_LIBRARY
+#include "miniz_prefix.h"
+#endif
 #include "miniz.h"
+#ifdef _WIN32
 #include "dokan.h"
 #include "atlbase.h"
 #include "atlfile.h"
 #include "atlconv.h"
+#else
+#define FUSE_USE_VERSION 34
+#include <fuse_lowlevel.h>
+#endif
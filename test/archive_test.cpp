@@ -0,0 +1,184 @@
+#include "stdafx.h"
+#include "archive.h"
+
+#include "zip_writer.h"
+
+// the archive core against archives written here, the malformed ones especially: each must either open and read
+// back what went in, or fail to open, never read outside the mapping
+static string temp_name(string const & name) { return (fs::temp_directory_path() / ("zipmount_test_" + name)).string(); }
+
+static bool save(string const & fname, string const & bytes) {
+    error_code ec; fs::remove(fname + ".zmidx", ec);
+
+    ofstream f(fname, ios::binary | ios::trunc); f.write(bytes.data(), bytes.size()); return (bool)f.flush();
+}
+
+// the whole of an entry through an open file, nothing if it cannot be read
+static optional<string> read_file(archive_t & a, string_view fpath) {
+    auto e = a.locate(fpath); if(!e.is_file()) return {};
+
+    auto f = a.open_file(e.index); string r(f->size, 0); auto good = !f->size || a.read(*f, 0, r.data(), r.size()); a.close_file(f);
+
+    if(!good) return {}; return r;
+}
+
+int main() {
+    // an archive without entries is a root without children
+    {
+        auto fname = temp_name("empty.zip"); archive_t a;
+
+        ok("empty archive") = save(fname, zip_writer_t {}.bytes()) && a.open(fname) && a.index.nodes.size() == 1 && !a.index.nodes[0].child_count;
+    }
+
+    // nothing in the last 64k looks like an end of central directory record
+    {
+        auto fname = temp_name("zeros.bin"); archive_t a, b;
+
+        ok("not an archive") = save(fname, string(200 << 10, 0)) && !a.open(fname) && save(fname, string(10, 0)) && !b.open(fname);
+    }
+
+    // an entry said to start past the end of the archive
+    {
+        auto fname = temp_name("offset.zip"); auto bytes = zip_writer_t {}.add("a.txt", "some data").bytes(); archive_t a; {
+            auto cdir = bytes.rfind("PK\x01\x02"); memset(bytes.data() + cdir + ZIP_CDH_LOCAL_HEADER_OFS, 0xFF, 4);
+        }
+
+        ok("entry past the end") = save(fname, bytes) && !a.open(fname);
+    }
+
+    // of two entries with the same name the first one in the central directory is served, however the sort goes
+    {
+        auto fname = temp_name("dups.zip"); zip_writer_t zip; for(int i = 0; i < 30000; ++i) {
+            zip.add(format("d{}/f{}", i % 7, i), "first"); zip.add(format("d{}/f{}", i % 7, i), "second");
+        }
+
+        archive_t a; auto good = zip.save(fname) && a.open(fname); for(int i = 0; good && i < 30000; ++i) {
+            good = read_file(a, format("d{}/f{}", i % 7, i)) == "first";
+        }
+
+        ok("duplicate names") = good;
+    }
+
+    // names that differ only in case are different entries, directories too, and a lookup matches case exactly
+    {
+        auto fname = temp_name("case.zip"); archive_t a; auto zip = zip_writer_t {}.add("Makefile", "upper").add("makefile", "lower").add("Src/a.c", "a").add("src/b.c", "b");
+
+        auto good = zip.save(fname) && a.open(fname) && a.index.nodes[0].child_count == 4 && read_file(a, "Makefile") == "upper" && read_file(a, "makefile") == "lower";
+
+        ok("names differing in case") = good && read_file(a, "Src/a.c") == "a" && read_file(a, "src/b.c") == "b" && !read_file(a, "MAKEFILE") && !read_file(a, "src/a.c");
+    }
+
+    // a read through an open file is one use of each block it touches, however the file then keeps its last block;
+    // a borrow that finds a block missing uses none, the read it falls back to counts them
+    {
+        struct counting_t : lru_policy_t {
+            atomic<uint64_t> & hits; counting_t(atomic<uint64_t> & hits) : hits(hits) {}
+
+            void hit(cache_entry_t * e) override { ++hits; lru_policy_t::hit(e); }
+        };
+
+        auto fname = temp_name("hits.zip"); string data(1 << 20, 0); for(size_t i = 0; i < data.size(); ++i) data[i] = "abcdefgh ijklm\n"[(i * 7919) % 15];
+
+        archive_t a; atomic<uint64_t> hits {0}; a.cache.set_policy(make_unique<counting_t>(hits));
+
+        auto good = zip_writer_t {}.add("a.txt", data, true).save(fname) && a.open(fname) && read_file(a, "a.txt") == data; a.drain();
+
+        auto f = a.open_file(a.locate("a.txt").index); char buf[100]; auto before = hits.load(); {
+            good = good && a.read(*f, archive_t::BLOCK_SIZE, buf, sizeof(buf)) && hits - before == 1 && a.read(*f, archive_t::BLOCK_SIZE + 100, buf, sizeof(buf)) && hits - before == 1;
+        }
+
+        auto node = a.locate("a.txt").index; a.cache.erase(archive_t::block_key(node, 2)); before = hits.load(); {
+            auto borrowed = [&](uint64_t offset) { return a.borrow(*f, offset, 2 * archive_t::BLOCK_SIZE, [](auto) {}); };
+
+            good = good && !borrowed(archive_t::BLOCK_SIZE) && hits == before && borrowed(0) && hits - before == 2;
+        }
+
+        a.close_file(f); ok(format("block hits per read {}", hits - before)) = good;
+    }
+
+    // readers all over a large entry share decode runs and the read-ahead workers; every run lands, one that runs out
+    // of memory too, and fails only the read it was for
+    {
+        auto fname = temp_name("flights.zip"); string data(12 << 20, 0); for(size_t i = 0; i < data.size(); ++i) data[i] = "abcdefgh ijklm\n"[(i * 7919 + i / 4096) % 15];
+
+        archive_t a; atomic<bool> good = zip_writer_t {}.add("big.txt", data, true).add("small.txt", "small", true).save(fname) && a.open(fname);
+
+        auto node = a.locate("big.txt").index; auto src = a.data_offset(node); vector<thread> threads; for(int t = 0; t < 8; ++t) threads.emplace_back([&, t] {
+            string buf(100000, 0); uint32_t seed = t; for(int i = 0; good && i < 50; ++i) {
+                seed = seed * 1103515245 + 12345; auto offset = (uint64_t)seed % (data.size() - buf.size());
+
+                if(!a.read(node, src, offset, buf.data(), buf.size()) || memcmp(buf.data(), data.data() + offset, buf.size())) good = false;
+            }
+        });
+
+        for(auto & t : threads) t.join(); a.drain();
+
+        static const codec_t throwing {"throwing", [](const uint8_t *, size_t, uint8_t *, size_t) -> bool { throw std::bad_alloc(); }};
+
+        auto codec = a.codec; a.codec = &throwing; auto failed = !read_file(a, "small.txt"); a.codec = codec;
+
+        ok("shared decode runs") = good && failed && a.flights.empty() && read_file(a, "small.txt") == "small";
+    }
+
+    // zip64 sizes just short of 2^64, which wrap around when added to an offset
+    {
+        auto fname = temp_name("zip64.zip"); archive_t a; auto huge = ~(uint64_t)0 - 1;
+
+        auto good = zip_writer_t {}.add("a.txt", "ok").add_zip64("b.bin", "tiny", huge, huge).save(fname) && (!a.open(fname) || (!read_file(a, "b.bin") && a.mapped(a.locate("b.bin").index).empty()));
+
+        ok("zip64 sizes near 2^64") = good;
+    }
+
+    // a local header whose extra field runs past the end: the central directory is fine, the entry is not readable
+    {
+        auto fname = temp_name("extra.zip"); auto bytes = zip_writer_t {}.add("a.txt", "some data").add("b.txt", "more data").bytes(); archive_t a; {
+            auto local = bytes.rfind("PK\x03\x04"); memset(bytes.data() + local + 28, 0xFF, 2);
+        }
+
+        ok("local extra field past the end") = save(fname, bytes) && a.open(fname) && read_file(a, "a.txt") == "some data" && !read_file(a, "b.txt") && a.mapped(a.locate("b.txt").index).empty();
+    }
+
+    // a sidecar that matches the archive but whose arrays point outside themselves is rebuilt, not used
+    {
+        auto fname = temp_name("sidecar.zip"); zip_writer_t zip; for(int i = 0; i < 100; ++i) zip.add(format("d{}/f{}", i % 5, i), format("data {}", i), i % 2);
+
+        archive_t a, b, c; auto good = zip.save(fname) && a.open(fname) && !a.phases.empty() && b.open(fname) && b.phases.empty(); {
+            fstream f(fname + ".zmidx", ios::binary | ios::in | ios::out); sidecar_t header; f.read((char *)&header, sizeof(header));
+
+            // the first child of the root
+            uint32_t bad = 0xFFFFFF00; f.seekp(header.section[1].offset); f.write((const char *)&bad, sizeof(bad)); good = good && f.flush();
+        }
+
+        good = good && c.open(fname) && !c.phases.empty(); for(int i = 0; good && i < 100; ++i) good = read_file(c, format("d{}/f{}", i % 5, i)) == format("data {}", i);
+
+        ok("corrupt sidecar") = good;
+    }
+
+    // opens of one archive racing to write its sidecar each end up with a whole index, and leave no temporary behind
+    {
+        auto fname = temp_name("race.zip"); zip_writer_t zip; for(int i = 0; i < 5000; ++i) zip.add(format("d{}/f{}", i % 13, i), format("data {}", i));
+
+        atomic<bool> good = zip.save(fname); vector<thread> threads; for(int t = 0; t < 8; ++t) threads.emplace_back([&] {
+            archive_t a; auto mine = a.open(fname); for(int i = 0; mine && i < 5000; i += 7) mine = read_file(a, format("d{}/f{}", i % 13, i)) == format("data {}", i);
+
+            if(!mine) good = false;
+        });
+
+        for(auto & t : threads) t.join();
+
+        for(auto & e : fs::directory_iterator(fs::path(fname).parent_path())) {
+            if(e.path().filename().string().starts_with("zipmount_test_race.zip.zmidx.")) good = false;
+        }
+
+        archive_t a; ok("concurrent sidecar writes") = good && a.open(fname) && a.phases.empty();
+    }
+
+    // auto-sizing keeps the cache within its bounds from the start, before the curve has seen a single block
+    {
+        archive_t a, b; a.cache.set_capacity(512 << 20); a.auto_size(16 << 20, 128 << 20, 0.95); b.cache.set_capacity(4 << 20); b.auto_size(16 << 20, 128 << 20, 0.95);
+
+        ok("cache within its bounds") = a.cache.capacity() == 128 << 20 && b.cache.capacity() == 16 << 20;
+    }
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+// runs the fuse frontend in process, without a kernel mount: tests call the lowlevel callbacks directly, and the
+// fuse_reply_* and fuse_add_direntry* below take the place of libfuse's (a definition in the program wins over the
+// shared library's), recording what the callback answered in the request; the rest of libfuse is never called
+#define main zipmount_main
+#include "../zipmount_fuse.cpp"
+#undef main
+
+#include "zip_writer.h"
+
+struct fuse_req {
+    int err {-1}; int replies {0}; fuse_entry_param entry {}; struct stat attr {}; double attr_timeout {0}; fuse_file_info fi {}; string data; struct statvfs st {};
+};
+
+// the entries fuse_add_direntry* lay out: this header (after a fuse_entry_param for the plus kind), the name, padding
+// to 8 bytes
+struct dirent_t {
+    uint64_t ino, off; uint32_t namelen, type;
+};
+
+extern "C" {
+    int fuse_reply_err(fuse_req_t req, int err) { req->err = err; ++req->replies; return 0; }
+
+    void fuse_reply_none(fuse_req_t req) { req->err = 0; ++req->replies; }
+
+    int fuse_reply_entry(fuse_req_t req, const fuse_entry_param * e) { req->err = 0; req->entry = *e; ++req->replies; return 0; }
+
+    int fuse_reply_attr(fuse_req_t req, const struct stat * attr, double attr_timeout) {
+        req->err = 0; req->attr = *attr; req->attr_timeout = attr_timeout; ++req->replies; return 0;
+    }
+
+    int fuse_reply_open(fuse_req_t req, const fuse_file_info * fi) { req->err = 0; req->fi = *fi; ++req->replies; return 0; }
+
+    int fuse_reply_buf(fuse_req_t req, const char * buf, size_t size) { req->err = 0; req->data.assign(buf ? buf : "", buf ? size : 0); ++req->replies; return 0; }
+
+    int fuse_reply_data(fuse_req_t req, fuse_bufvec * bufv, fuse_buf_copy_flags flags) {
+        req->err = 0; req->data.clear(); ++req->replies; for(size_t i = bufv->idx; i < bufv->count; ++i) {
+            auto & b = bufv->buf[i]; auto skip = i == bufv->idx ? bufv->off : 0; if(!(b.flags & FUSE_BUF_IS_FD)) {
+                req->data.append((const char *)b.mem + skip, b.size - skip); continue;
+            }
+
+            string s(b.size - skip, 0); auto n = pread(b.fd, s.data(), s.size(), b.pos + (off_t)skip); if(n != (ssize_t)s.size()) {
+                req->err = EIO; return -EIO;
+            }
+
+            req->data += s;
+        }
+
+        return 0;
+    }
+
+    int fuse_reply_statfs(fuse_req_t req, const struct statvfs * stbuf) { req->err = 0; req->st = *stbuf; ++req->replies; return 0; }
+
+    size_t fuse_add_direntry(fuse_req_t req, char * buf, size_t bufsize, const char * name, const struct stat * stbuf, off_t off) {
+        auto n = strlen(name), size = (sizeof(dirent_t) + n + 7) & ~(size_t)7; if(!buf || size > bufsize) return size;
+
+        dirent_t d {(uint64_t)stbuf->st_ino, (uint64_t)off, (uint32_t)n, (uint32_t)(stbuf->st_mode & S_IFMT) >> 12}; {
+            memset(buf, 0, size); memcpy(buf, &d, sizeof(d)); memcpy(buf + sizeof(d), name, n);
+        }
+
+        return size;
+    }
+
+    size_t fuse_add_direntry_plus(fuse_req_t req, char * buf, size_t bufsize, const char * name, const fuse_entry_param * e, off_t off) {
+        auto n = strlen(name), size = (sizeof(fuse_entry_param) + sizeof(dirent_t) + n + 7) & ~(size_t)7; if(!buf || size > bufsize) return size;
+
+        dirent_t d {(uint64_t)e->attr.st_ino, (uint64_t)off, (uint32_t)n, (uint32_t)(e->attr.st_mode & S_IFMT) >> 12}; {
+            memset(buf, 0, size); memcpy(buf, e, sizeof(*e)); memcpy(buf + sizeof(*e), &d, sizeof(d)); memcpy(buf + sizeof(*e) + sizeof(d), name, n);
+        }
+
+        return size;
+    }
+}
+
+// one call of a callback, the reply comes back in the request
+template<typename F, typename... A>
+static fuse_req call(F && f, A &&... a) {
+    fuse_req r; f(&r, std::forward<A>(a)...); return r;
+}
+
+// the children of a directory as the listing gives them, in pages of up to page_size bytes; "." and ".." left out,
+// plus entries carry their fuse_entry_param
+struct listed_t {
+    string name; dirent_t d; fuse_entry_param e;
+};
+
+static bool list_dir(fuse_ino_t ino, bool plus, size_t page_size, vector<listed_t> & r) {
+    fuse_file_info fi {}; auto opened = call(zmOpenDir, ino, &fi); if(opened.err) return false;
+
+    r.clear(); fi = opened.fi; bool good = true; for(off_t off = 0;;) {
+        auto page = plus ? call(zmReadDirPlus, ino, page_size, off, &fi) : call(zmReadDir, ino, page_size, off, &fi);
+
+        if(page.err || page.replies != 1) good = false; if(!good || page.data.empty()) break;
+
+        for(size_t p = 0; p < page.data.size();) {
+            listed_t l {}; auto head = plus ? sizeof(l.e) : 0; {
+                if(plus) memcpy(&l.e, page.data.data() + p, sizeof(l.e)); memcpy(&l.d, page.data.data() + p + head, sizeof(l.d));
+
+                l.name.assign(page.data.data() + p + head + sizeof(l.d), l.d.namelen);
+            }
+
+            p += (head + sizeof(l.d) + l.d.namelen + 7) & ~(size_t)7; off = (off_t)l.d.off; if(l.name != "." && l.name != "..") r.push_back(l);
+        }
+    }
+
+    call(zmReleaseDir, ino, &fi); return good;
+}
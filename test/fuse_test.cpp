@@ -0,0 +1,226 @@
+#include "stdafx.h"
+#include "fuse_driver.h"
+
+#include <set>
+
+// the fuse frontend against an archive written here: lookups, attributes, listings through readdir and readdirplus,
+// reads of stored and deflated entries, and the errors the callbacks answer with
+static string content(size_t size, uint32_t seed) {
+    // text-like so that deflate has something to do, different per file
+    string r(size, 0); for(size_t i = 0; i < size; ++i) {
+        seed = seed * 1103515245 + 12345; r[i] = "abcdefgh ijklm\n"[(seed >> 16) % 15];
+    }
+
+    return r;
+}
+
+static fuse_req lookup(string_view fpath) {
+    fuse_req r; r.err = 0; r.entry.ino = FUSE_ROOT_ID; for(size_t i = 0; i < fpath.size();) {
+        auto j = fpath.find('/', i); if(j == string_view::npos) j = fpath.size();
+
+        r = call(zmLookup, r.entry.ino, string(fpath.substr(i, j - i)).c_str()); if(r.err || !r.entry.ino) break;
+
+        i = j + 1;
+    }
+
+    return r;
+}
+
+static bool read_all(fuse_ino_t ino, size_t size, size_t chunk, string & r) {
+    fuse_file_info fi {}; fi.flags = O_RDONLY; auto opened = call(zmOpen, ino, &fi); if(opened.err || !opened.fi.keep_cache) return false;
+
+    r.clear(); fi = opened.fi; bool good = true; for(size_t off = 0; good && off < size;) {
+        auto got = call(zmRead, ino, chunk, (off_t)off, &fi); good = !got.err && got.replies == 1 && !got.data.empty(); r += got.data; off += got.data.size();
+    }
+
+    // nothing past the end
+    auto eof = call(zmRead, ino, chunk, (off_t)size, &fi); good = good && !eof.err && eof.data.empty();
+
+    call(zmRelease, ino, &fi); return good && r.size() == size;
+}
+
+// what the kernel keeps of the replies, as far as the daemon can tell: dentries (negative ones too) and attributes
+// for as long as their timeouts say, a file's pages across opens when keep_cache is set and a directory's listing
+// when cache_readdir is; an open always reaches the daemon
+struct kernel_t {
+    map<pair<fuse_ino_t, string>, fuse_ino_t> dentries; map<fuse_ino_t, struct stat> attrs; map<fuse_ino_t, string> pages; map<fuse_ino_t, vector<string>> listings;
+
+    fuse_ino_t resolve(string_view fpath) {
+        fuse_ino_t ino = FUSE_ROOT_ID; for(size_t i = 0; ino && i < fpath.size();) {
+            auto j = fpath.find('/', i); if(j == string_view::npos) j = fpath.size();
+
+            string name {fpath.substr(i, j - i)}; if(auto d = dentries.find({ino, name}); d != dentries.end()) {
+                ino = d->second;
+            }
+            else {
+                auto r = call(zmLookup, ino, name.c_str()); if(r.err) return 0;
+
+                if(r.entry.entry_timeout > 0) dentries[{ino, name}] = r.entry.ino; if(r.entry.ino && r.entry.attr_timeout > 0) attrs[r.entry.ino] = r.entry.attr;
+
+                ino = r.entry.ino;
+            }
+
+            i = j + 1;
+        }
+
+        return ino;
+    }
+
+    optional<struct stat> stat(string_view fpath) {
+        auto ino = resolve(fpath); if(!ino) return {}; if(auto a = attrs.find(ino); a != attrs.end()) return a->second;
+
+        auto r = call(zmGetAttr, ino, nullptr); if(r.err) return {}; if(r.attr_timeout > 0) attrs[ino] = r.attr;
+
+        return r.attr;
+    }
+
+    optional<string> read(string_view fpath) {
+        auto a = stat(fpath); if(!a) return {};
+
+        auto ino = a->st_ino; fuse_file_info fi {}; fi.flags = O_RDONLY; auto opened = call(zmOpen, ino, &fi); if(opened.err) return {};
+
+        fi = opened.fi; if(!fi.keep_cache) pages.erase(ino);
+
+        if(!pages.count(ino)) {
+            string r; for(off_t off = 0; off < a->st_size;) {
+                auto got = call(zmRead, ino, 131072, off, &fi); if(got.err || got.data.empty()) break; r += got.data; off += (off_t)got.data.size();
+            }
+
+            pages[ino] = r;
+        }
+
+        call(zmRelease, ino, &fi); return pages[ino];
+    }
+
+    optional<vector<string>> readdir(string_view fpath) {
+        auto ino = resolve(fpath); if(!ino) return {};
+
+        fuse_file_info fi {}; auto opened = call(zmOpenDir, ino, &fi); if(opened.err) return {}; call(zmReleaseDir, ino, &opened.fi);
+
+        if(!opened.fi.cache_readdir || !listings.count(ino)) {
+            vector<listed_t> listed; if(!list_dir(ino, true, 4096, listed)) return {};
+
+            auto & names = listings[ino]; names.clear(); for(auto & l : listed) names.push_back(l.name);
+        }
+
+        return listings[ino];
+    }
+};
+
+int main() {
+    auto fname = (fs::temp_directory_path() / "zipmount_fuse_test.zip").string();
+
+    map<string, string> files {
+        {"readme.txt", "hello\n"}, {"Makefile", "all:\n"}, {"makefile", "all: twice\n"}, {"src/main.cpp", content(40000, 1)}, {"src/lib/util.h", content(3000, 2)}, {"data/empty.txt", ""},
+        {"data/big.bin", content(3 << 20, 3)}, {"data/raw.bin", content(1 << 20, 4)},
+    };
+
+    for(int i = 0; i < 300; ++i) files[format("many/file{:03}.txt", i)] = content(100 + i, 5 + i);
+
+    set<string> dirs {"src", "src/lib", "data", "many", "empty"};
+
+    zip_writer_t zip; {
+        int i = 0; for(auto & [name, data] : files) zip.add(name, data, ++i % 2 == 0 || name == "data/big.bin");
+
+        zip.add("empty/");
+    }
+
+    ok(format("write {}", fname)) = zip.save(fname);
+
+    ok(format("open  {}", fname)) = $archive.open(fname);
+
+    fuse_conn_info conn {}; conn.capable = ~0u; conn.want = FUSE_CAP_AUTO_INVAL_DATA | FUSE_CAP_READDIRPLUS_AUTO; zmInit(nullptr, &conn);
+
+    ok("init") = (conn.want & FUSE_CAP_READDIRPLUS) && !(conn.want & (FUSE_CAP_AUTO_INVAL_DATA | FUSE_CAP_READDIRPLUS_AUTO));
+
+    // every entry resolves, one component at a time, to attributes the kernel may keep forever
+    bool good = true; for(auto & [name, data] : files) {
+        auto r = lookup(name); auto & a = r.entry.attr; auto node_index = node_of(r.entry.ino);
+
+        good = good && !r.err && r.replies == 1 && r.entry.ino && node_index >= 0 && a.st_ino == r.entry.ino && S_ISREG(a.st_mode) && (size_t)a.st_size == data.size();
+        good = good && r.entry.entry_timeout >= FOREVER && r.entry.attr_timeout >= FOREVER && (uint64_t)a.st_blocks == ($archive.index.meta.comp_size[node_index] + 511) / 512;
+
+        auto attr = call(zmGetAttr, r.entry.ino, nullptr); good = good && !attr.err && attr.attr.st_ino == r.entry.ino && attr.attr_timeout >= FOREVER;
+    }
+
+    for(auto & name : dirs) {
+        auto r = lookup(name); good = good && !r.err && S_ISDIR(r.entry.attr.st_mode);
+    }
+
+    ok(format("lookup {} files, {} directories", files.size(), dirs.size())) = good;
+
+    // a miss is a negative entry the kernel may keep as long, under a parent that does not exist it is an error
+    auto miss = lookup("src/nope.cpp"), orphan = call(zmLookup, (fuse_ino_t)1 << 40, "x");
+
+    ok("lookup misses") = !miss.err && !miss.entry.ino && miss.entry.entry_timeout >= FOREVER && orphan.err == ENOENT;
+
+    // both kinds of listing, in pages of a few entries and of many, give every child once
+    auto children = [&](string const & dir) {
+        vector<string> r; for(auto & [name, data] : files) {
+            if(path(name).parent_path().string() == dir) r.push_back(path(name).filename().string());
+        }
+
+        for(auto & name : dirs) {
+            if(path(name).parent_path().string() == dir) r.push_back(path(name).filename().string());
+        }
+
+        std::sort(r.begin(), r.end()); return r;
+    };
+
+    good = true; for(auto & dir : vector<string> {"", "src", "data", "many", "empty"}) {
+        auto ino = dir.empty() ? FUSE_ROOT_ID : lookup(dir).entry.ino; for(auto plus : {false, true}) for(size_t page : {512, 4096, 65536}) {
+            vector<listed_t> listed; good = good && list_dir(ino, plus, page, listed);
+
+            vector<string> names; for(auto & l : listed) {
+                names.push_back(l.name); auto child = lookup(dir.empty() ? l.name : dir + "/" + l.name).entry.ino;
+
+                good = good && l.d.ino == child && (!plus || (l.e.ino == child && l.e.attr.st_ino == child && l.e.entry_timeout >= FOREVER));
+            }
+
+            std::sort(names.begin(), names.end()); good = good && names == children(dir);
+        }
+    }
+
+    ok("list directories") = good;
+
+    // stored and deflated entries, read in pieces that do and do not line up with the cache's blocks
+    good = true; for(auto & [name, data] : files) {
+        for(size_t chunk : {4096, 131072, 100003}) {
+            string got; good = good && read_all(lookup(name).entry.ino, data.size(), chunk, got) && got == data;
+        }
+    }
+
+    ok(format("read {} files", files.size())) = good;
+
+    fuse_file_info fi {}; auto dir = lookup("src").entry.ino, file = lookup("readme.txt").entry.ino;
+
+    fi.flags = O_RDONLY; auto is_dir = call(zmOpen, dir, &fi); fi.flags = O_WRONLY; auto read_only = call(zmOpen, file, &fi); auto not_dir = call(zmOpenDir, file, &fi);
+
+    auto no_attr = call(zmGetAttr, (fuse_ino_t)1 << 40, nullptr);
+
+    ok("errors") = is_dir.err == EISDIR && read_only.err == EROFS && not_dir.err == ENOTDIR && no_attr.err == ENOENT;
+
+    auto st = call(zmStatFs, FUSE_ROOT_ID);
+
+    ok("statfs") = !st.err && st.st.f_files == $archive.index.nodes.size() && st.st.f_blocks * st.st.f_frsize >= $archive.data_size();
+
+    // a second round of stat, open and read over every file, and of listing every directory, only reaches the daemon
+    // for the opens: the kernel may keep everything else it got the first time
+    kernel_t kernel; auto round = [&] {
+        bool good = true; for(auto & [name, data] : files) good = good && kernel.stat(name) && kernel.read(name) == data;
+
+        for(auto & name : dirs) good = good && kernel.readdir(name); good = good && !kernel.stat("src/nope.cpp") && kernel.readdir("");
+
+        return good;
+    };
+
+    auto counts = [] { return array<uint64_t, 5> {calls.lookup, calls.getattr, calls.open, calls.read, calls.readdir}; };
+
+    auto before = counts(); auto first = round(); auto between = counts(); auto second = round(); auto after = counts();
+
+    ok(format("cached round lookup {} getattr {} open {} read {} readdir {}", after[0] - between[0], after[1] - between[1], after[2] - between[2], after[3] - between[3], after[4] - between[4])) =
+        first && second && between[0] > before[0] && between[3] > before[3] && after[0] == between[0] && after[1] == between[1] && after[2] - between[2] == files.size() &&
+        after[3] == between[3] && after[4] == between[4];
+
+    $archive.drain(); return 0;
+}
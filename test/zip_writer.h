@@ -0,0 +1,76 @@
+#pragma once
+
+// writes the archives the tests and benchmarks run on: entries are stored or deflated (raw deflate through tdefl) and
+// their names go in exactly as given, with zip64 end records once there are too many for 16 bits; a zip64 entry may
+// claim sizes that have nothing to do with its data, which is how a test builds an archive that lies
+struct zip_writer_t {
+    struct entry_t {
+        string name; string data; bool deflate; optional<pair<uint64_t, uint64_t>> claimed;
+    };
+
+    vector<entry_t> entries;
+
+    zip_writer_t & add(string name, string data = {}, bool deflate = false) {
+        entries.push_back({std::move(name), std::move(data), deflate, {}}); return *this;
+    }
+
+    // a stored entry whose zip64 extra fields say it holds size bytes, comp_size of them in the archive
+    zip_writer_t & add_zip64(string name, string data, uint64_t size, uint64_t comp_size) {
+        entries.push_back({std::move(name), std::move(data), false, pair {size, comp_size}}); return *this;
+    }
+
+    string bytes() const {
+        auto le = [](string & s, uint64_t v, int n) { for(int i = 0; i < n; ++i) s += (char)(v >> (8 * i)); };
+
+        // 2020-01-01 12:00:00
+        enum : uint16_t { DOS_TIME = 12 << 11, DOS_DATE = (2020 - 1980) << 9 | 1 << 5 | 1 };
+
+        string r, cdir; for(auto & e : entries) {
+            auto crc = (uint32_t)mz_crc32(MZ_CRC32_INIT, (const uint8_t *)e.data.data(), e.data.size()); string body = e.data;
+
+            if(e.deflate) {
+                size_t n = 0; auto p = tdefl_compress_mem_to_heap(e.data.data(), e.data.size(), &n, TDEFL_DEFAULT_MAX_PROBES); body.assign((const char *)p, n); mz_free(p);
+            }
+
+            uint64_t size = e.data.size(), comp_size = body.size(); string extra; if(e.claimed) {
+                size = e.claimed->first; comp_size = e.claimed->second; le(extra, 1, 2); le(extra, 16, 2); le(extra, size, 8); le(extra, comp_size, 8);
+            }
+
+            auto header = [&](bool central) {
+                string h; le(h, central ? 0x02014b50 : 0x04034b50, 4); if(central) le(h, 20, 2);
+
+                le(h, e.claimed ? 45 : 20, 2); le(h, 0, 2); le(h, e.deflate ? MZ_DEFLATED : 0, 2); le(h, DOS_TIME, 2); le(h, DOS_DATE, 2); le(h, crc, 4);
+                le(h, e.claimed ? 0xFFFFFFFF : comp_size, 4); le(h, e.claimed ? 0xFFFFFFFF : size, 4); le(h, e.name.size(), 2); le(h, extra.size(), 2);
+
+                if(central) {
+                    le(h, 0, 2); le(h, 0, 2); le(h, 0, 2); le(h, !e.name.empty() && e.name.back() == '/' ? 0x10 : 0, 4); le(h, r.size(), 4);
+                }
+
+                return h + e.name + extra;
+            };
+
+            cdir += header(true); r += header(false); r += body;
+        }
+
+        auto cdir_ofs = r.size(); r += cdir;
+
+        // past 16-bit entry counts the zip64 end of central directory record and its locator hold the real figures
+        auto zip64 = entries.size() >= 0xFFFF; if(zip64) {
+            auto eocd64_ofs = r.size(); le(r, 0x06064b50, 4); le(r, 44, 8); le(r, 45, 2); le(r, 45, 2); le(r, 0, 4); le(r, 0, 4);
+            le(r, entries.size(), 8); le(r, entries.size(), 8); le(r, cdir.size(), 8); le(r, cdir_ofs, 8);
+
+            le(r, 0x07064b50, 4); le(r, 0, 4); le(r, eocd64_ofs, 8); le(r, 1, 4);
+        }
+
+        auto count = zip64 ? 0xFFFF : entries.size(); le(r, 0x06054b50, 4); le(r, 0, 4); le(r, count, 2); le(r, count, 2); le(r, cdir.size(), 4); le(r, cdir_ofs, 4); le(r, 0, 2);
+
+        return r;
+    }
+
+    // drops any sidecar left from an archive of the same name, it would still match a rewrite in the same second
+    bool save(string const & fname) const {
+        error_code ec; fs::remove(fname + ".zmidx", ec);
+
+        ofstream f(fname, ios::binary | ios::trunc); auto b = bytes(); f.write(b.data(), b.size()); return (bool)f.flush();
+    }
+};
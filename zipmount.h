@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+// zipmount as a library: the archive's index and block cache in process, without a mount and a kernel round trip per
+// call; an archive may be read from any number of threads once open() returned, and a process may open any number
+// of them, each with a cache of its own
+namespace zipmount {
+    struct options_t {
+        uint64_t cache_size {512 << 20}; std::string codec {"fast"}; std::string policy {"tinylfu"};
+    };
+
+    // the views point into the index and stay valid while the archive is open
+    struct stat_t {
+        std::string_view path; std::string_view name; uint64_t size; int64_t mtime; bool dir;
+    };
+
+    // files and directories are nodes, the root is node 0; an archive that is not open answers every call like one
+    // without the node asked for
+    class archive {
+    public:
+        archive(); ~archive();
+
+        archive(archive &&) noexcept; archive & operator=(archive &&) noexcept;
+
+        // maps the zip and loads its index, from <fname>.zmidx when that is still current or else from the central
+        // directory, writing the sidecar for next time; false if it is not a readable zip or an option is unknown
+        bool open(std::string const & fname, options_t const & options = {});
+
+        // the node of a path, matched exactly (case included), "" is the root; -1 if there is none
+        int lookup(std::string_view fpath) const;
+
+        std::optional<stat_t> stat(int node) const;
+
+        // the children of a directory, sorted by name
+        std::span<const uint32_t> list(int node) const;
+
+        // copies up to n bytes at offset into dst, fewer only at the end of the file; -1 if node is not a file or
+        // its data is corrupt
+        int64_t read_at(int node, uint64_t offset, void * dst, size_t n);
+
+        // the bytes of a stored (uncompressed) file where they lie in the mapped archive, empty for anything else
+        std::span<const uint8_t> map_span(int node) const;
+
+    private:
+        struct impl; std::unique_ptr<impl> m_impl;
+    };
+}
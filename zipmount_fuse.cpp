@@ -0,0 +1,296 @@
+#include "stdafx.h"
+#include "archive.h"
+
+// the linux frontend, a libfuse3 low-level file system over $archive; an inode number is a node index plus
+// FUSE_ROOT_ID, so the root is node 0 and every callback goes straight to the index without resolving paths
+using file_t = decltype($archive)::file_t;
+
+// nothing in the mount ever changes, the kernel may keep entries, attributes, failed lookups, file pages and
+// directory listings for as long as it likes and only comes back once it dropped them under memory pressure
+static constexpr double FOREVER = 365.0 * 24 * 3600;
+
+// how often each callback ran, with the kernel caching everything repeated work should not show up here
+static struct {
+    atomic<uint64_t> lookup, getattr, open, read, readdir;
+} calls;
+
+// a directory rendered once for readdirplus: the entries back to back as the kernel takes them, and where each one
+// starts, so that any page of the listing is one contiguous slice of the buffer
+struct listing_t {
+    buffer_t entries; vector<uint32_t> starts;
+
+    size_t size() const { return entries.size() + starts.size() * sizeof(uint32_t); }
+};
+
+static policy_cache<int, listing_t> listings {64 << 20};
+
+using listing_handle = decltype(listings)::handle;
+
+static fuse_ino_t ino_of(int node_index) { return (fuse_ino_t)node_index + FUSE_ROOT_ID; }
+
+// the node of an inode number, -1 if the kernel hands us one we never gave out
+static int node_of(fuse_ino_t ino) { return ino >= FUSE_ROOT_ID && ino - FUSE_ROOT_ID < $archive.index.nodes.size() ? (int)(ino - FUSE_ROOT_ID) : -1; }
+
+static struct stat attr_of(int node_index) {
+    auto st = $archive.stat(node_index); struct stat r {}; {
+        r.st_ino = ino_of(node_index); r.st_mode = st.is_dir() ? S_IFDIR | 0555 : S_IFREG | 0444; r.st_nlink = st.is_dir() ? 2 : 1;
+        r.st_uid = getuid(); r.st_gid = getgid(); r.st_size = (off_t)st.size; r.st_blksize = 4096;
+
+        // an entry takes up its compressed size in the archive, which is what du should add up
+        r.st_blocks = (blkcnt_t)(($archive.index.meta.comp_size[node_index] + 511) / 512);
+        r.st_atime = r.st_mtime = r.st_ctime = (time_t)st.mtime;
+    }
+
+    return r;
+}
+
+static fuse_entry_param entry_of(int node_index) {
+    fuse_entry_param e {}; {
+        e.ino = ino_of(node_index); e.attr = attr_of(node_index); e.attr_timeout = e.entry_timeout = FOREVER;
+    }
+
+    return e;
+}
+
+// fs callbacks
+static void zmInit(void * userdata, fuse_conn_info * conn) {
+    // attributes never change, so a getattr must not throw the cached pages away
+    conn->want &= ~FUSE_CAP_AUTO_INVAL_DATA;
+
+    // replies may be spliced into the device instead of written through a copy
+    conn->want |= conn->capable & (FUSE_CAP_SPLICE_WRITE | FUSE_CAP_SPLICE_MOVE);
+
+    // a listing brings the attributes of every child along, ls -l or find need no lookup per entry
+    if(conn->capable & FUSE_CAP_READDIRPLUS) {
+        conn->want |= FUSE_CAP_READDIRPLUS; conn->want &= ~FUSE_CAP_READDIRPLUS_AUTO;
+    }
+}
+
+static void zmLookup(fuse_req_t req, fuse_ino_t parent, const char * name) {
+    ++calls.lookup; auto parent_index = node_of(parent); if(parent_index < 0) {
+        fuse_reply_err(req, ENOENT); return;
+    }
+
+    thread_local string fpath; fpath = $archive.index.fpath_of($archive.index.nodes[parent_index]); {
+        if(!fpath.empty()) fpath += '/'; fpath += name;
+    }
+
+    // a miss answered with inode 0 is cached as a negative entry
+    fuse_entry_param e {}; e.entry_timeout = FOREVER; auto [ftype, findex] = $archive.locate(fpath); if(ftype) e = entry_of(findex);
+
+    fuse_reply_entry(req, &e);
+}
+
+static void zmGetAttr(fuse_req_t req, fuse_ino_t ino, fuse_file_info * fi) {
+    ++calls.getattr; auto node_index = node_of(ino); if(node_index < 0) {
+        fuse_reply_err(req, ENOENT); return;
+    }
+
+    auto attr = attr_of(node_index); fuse_reply_attr(req, &attr, FOREVER);
+}
+
+static void zmOpen(fuse_req_t req, fuse_ino_t ino, fuse_file_info * fi) {
+    ++calls.open; auto node_index = node_of(ino); if(node_index < 0) {
+        fuse_reply_err(req, ENOENT); return;
+    }
+
+    if($archive.index.nodes[node_index].type != $archive.FILE) {
+        fuse_reply_err(req, EISDIR); return;
+    }
+
+    if((fi->flags & O_ACCMODE) != O_RDONLY) {
+        fuse_reply_err(req, EROFS); return;
+    }
+
+    // the pages of an earlier open are still good
+    fi->fh = (uint64_t)$archive.open_file(node_index); fi->keep_cache = 1; fuse_reply_open(req, fi);
+}
+
+static void zmRelease(fuse_req_t req, fuse_ino_t ino, fuse_file_info * fi) {
+    if(auto f = (file_t *)fi->fh) $archive.close_file(f);
+
+    fuse_reply_err(req, 0);
+}
+
+static void zmRead(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, fuse_file_info * fi) {
+    ++calls.read; auto & file = *(file_t *)fi->fh;
+
+    if(off < 0 || (uint64_t)off >= file.size) {
+        fuse_reply_buf(req, nullptr, 0); return;
+    }
+
+    auto toread = std::min<uint64_t>(file.size - off, size);
+
+    // stored data goes out as a range of the archive file, which the kernel can splice from its page cache
+    if(!file.stored.empty()) {
+        fuse_bufvec v = FUSE_BUFVEC_INIT(toread); {
+            v.buf[0].flags = (fuse_buf_flags)(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK); v.buf[0].fd = $archive.fmapping.fd(); v.buf[0].pos = (off_t)(file.stored.data() - $archive.data()) + off;
+        }
+
+        fuse_reply_data(req, &v, FUSE_BUF_SPLICE_MOVE); return;
+    }
+
+    // cached blocks go out straight from the cache's pages, they stay pinned until the reply is written
+    auto borrowed = $archive.borrow(file, off, toread, [&](span<const span<const uint8_t>> slices) {
+        buffer_t storage(sizeof(fuse_bufvec) + (slices.size() - 1) * sizeof(fuse_buf)); auto & v = *(fuse_bufvec *)storage.data(); {
+            v.count = slices.size(); v.idx = v.off = 0; for(size_t i = 0; i < slices.size(); ++i) {
+                v.buf[i] = {slices[i].size(), (fuse_buf_flags)0, (void *)slices[i].data(), -1, 0};
+            }
+        }
+
+        fuse_reply_data(req, &v, (fuse_buf_copy_flags)0);
+    });
+
+    if(borrowed) return;
+
+    buffer_t buffer(toread); if(!$archive.read(file, off, buffer.data(), toread)) {
+        fuse_reply_err(req, EIO); return;
+    }
+
+    fuse_reply_buf(req, (const char *)buffer.data(), toread);
+}
+
+static void zmOpenDir(fuse_req_t req, fuse_ino_t ino, fuse_file_info * fi) {
+    auto node_index = node_of(ino); if(node_index < 0) {
+        fuse_reply_err(req, ENOENT); return;
+    }
+
+    if($archive.index.nodes[node_index].type != $archive.DIR) {
+        fuse_reply_err(req, ENOTDIR); return;
+    }
+
+    fi->fh = (uint64_t)new listing_handle; fi->keep_cache = fi->cache_readdir = 1; fuse_reply_open(req, fi);
+}
+
+// offsets are positions in the listing: 0 is ".", 1 is ".." and 2 + i the i-th child
+static void zmReadDir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, fuse_file_info * fi) {
+    ++calls.readdir; auto & node = $archive.index.nodes[node_of(ino)]; buffer_t buffer(size); size_t used = 0;
+
+    for(auto i = (uint64_t)off; i < node.child_count + 2u; ++i) {
+        struct stat st {}; const char * name; if(i < 2) {
+            st.st_ino = i ? ino_of(node.parent) : ino; st.st_mode = S_IFDIR; name = i ? ".." : ".";
+        }
+        else {
+            auto child = $archive.index.children[node.first_child + i - 2]; st.st_ino = ino_of(child);
+            st.st_mode = $archive.index.nodes[child].type == $archive.DIR ? S_IFDIR : S_IFREG; name = $archive.index.fname_of($archive.index.nodes[child]).data();
+        }
+
+        auto n = fuse_add_direntry(req, (char *)buffer.data() + used, size - used, name, &st, (off_t)i + 1); if(n > size - used) break;
+
+        used += n;
+    }
+
+    fuse_reply_buf(req, (const char *)buffer.data(), used);
+}
+
+// fuse_add_direntry_plus() only formats, the request does not matter and the listing can be rendered ahead of time
+static listing_t render(fuse_req_t req, int node_index) {
+    auto & node = $archive.index.nodes[node_index]; auto name_of = [&](uint32_t i) {
+        return i < 2 ? (i ? ".." : ".") : $archive.index.fname_of($archive.index.nodes[$archive.index.children[node.first_child + i - 2]]).data();
+    };
+
+    auto entry = [&](uint32_t i) { return entry_of(i < 2 ? (i ? (int)node.parent : node_index) : (int)$archive.index.children[node.first_child + i - 2]); };
+
+    listing_t r; r.starts.resize(node.child_count + 3); size_t size = 0; for(uint32_t i = 0; i < node.child_count + 2; ++i) {
+        auto e = entry(i); r.starts[i] = (uint32_t)size; size += fuse_add_direntry_plus(req, nullptr, 0, name_of(i), &e, i + 1);
+    }
+
+    r.starts.back() = (uint32_t)size; r.entries = buffer_t(size); for(uint32_t i = 0; i < node.child_count + 2; ++i) {
+        auto e = entry(i); fuse_add_direntry_plus(req, (char *)r.entries.data() + r.starts[i], r.starts[i + 1] - r.starts[i], name_of(i), &e, i + 1);
+    }
+
+    return r;
+}
+
+// pages through the rendered listing of the directory, rendering it on the first call; the handle keeps the listing
+// alive while the directory is open even if the cache let go of it meanwhile
+static void zmReadDirPlus(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, fuse_file_info * fi) {
+    ++calls.readdir; auto & listing = *(listing_handle *)fi->fh; if(!listing) {
+        auto node_index = node_of(ino); if(!(listing = listings.get(node_index))) listing = listings.insert(node_index, render(req, node_index));
+    }
+
+    auto & starts = listing->starts; if(off < 0 || (size_t)off + 1 >= starts.size()) {
+        fuse_reply_buf(req, nullptr, 0); return;
+    }
+
+    // as many whole entries as fit, starting with the one at off
+    auto first = starts[off], last = *std::prev(std::upper_bound(starts.begin() + off, starts.end(), first + (uint32_t)std::min<size_t>(size, UINT32_MAX - first)));
+
+    fuse_reply_buf(req, (const char *)listing->entries.data() + first, last - first);
+}
+
+static void zmReleaseDir(fuse_req_t req, fuse_ino_t ino, fuse_file_info * fi) {
+    delete (listing_handle *)fi->fh; fuse_reply_err(req, 0);
+}
+
+static void zmStatFs(fuse_req_t req, fuse_ino_t ino) {
+    struct statvfs st {}; {
+        st.f_bsize = st.f_frsize = 4096; st.f_blocks = ($archive.data_size() + 4095) / 4096; st.f_files = $archive.index.nodes.size(); st.f_namemax = 255;
+    }
+
+    fuse_reply_statfs(req, &st);
+}
+
+struct zipmount_options {
+    string archive_fname; string mount_point; optional<size_t> cache_size {512}; optional<string> codec {"fast"}; optional<string> policy {"tinylfu"};
+    optional<size_t> cache_min {64}; optional<size_t> cache_max; optional<double> hit_rate {95}; optional<size_t> threads {16};
+};
+
+STRUCTOPT(zipmount_options, archive_fname, mount_point, cache_size, codec, policy, cache_min, cache_max, hit_rate, threads);
+
+int main(int argc, char ** argv) {
+    try {
+        auto options = structopt::app(APP_NAME, APP_VERSION).parse<zipmount_options>(argc, argv);
+
+        prepare(options);
+
+        fuse_lowlevel_ops ops {}; {
+            ops.init = zmInit;
+            ops.lookup = zmLookup;
+            ops.getattr = zmGetAttr;
+            ops.open = zmOpen;
+            ops.release = zmRelease;
+            ops.read = zmRead;
+            ops.opendir = zmOpenDir;
+            ops.readdir = zmReadDir;
+            ops.readdirplus = zmReadDirPlus;
+            ops.releasedir = zmReleaseDir;
+            ops.statfs = zmStatFs;
+        }
+
+        // commas separate mount options, the archive name must not add any
+        string name = path(options.archive_fname).filename().string(), fsname; for(auto c : name) {
+            if(c == ',' || c == '\\') fsname += '\\'; fsname += c;
+        }
+
+        auto mount_options = format("ro,default_permissions,subtype={},fsname={}", APP_NAME, fsname);
+
+        const char * fuse_argv[] {argv[0], "-o", mount_options.c_str()}; fuse_args args = FUSE_ARGS_INIT(3, (char **)fuse_argv);
+
+        auto session = fuse_session_new(&args, &ops, sizeof(ops), nullptr);
+
+        ok(format("mount {}", options.mount_point)) =
+            session && !fuse_set_signal_handlers(session) && !fuse_session_mount(session, options.mount_point.c_str());
+
+        ok("ready, (CTRL + C) to quit");
+
+        fuse_loop_config config {}; {
+            config.clone_fd = 0; config.max_idle_threads = (unsigned)options.threads.value();
+        }
+
+        auto rc = fuse_session_loop_mt(session, &config); {
+            fuse_session_unmount(session); fuse_remove_signal_handlers(session); fuse_session_destroy(session);
+        }
+
+        finish(); {
+            ok(format("calls lookup {} getattr {} open {} read {} readdir {}", calls.lookup.load(), calls.getattr.load(), calls.open.load(), calls.read.load(), calls.readdir.load())) = true;
+        }
+
+        return rc ? 1 : 0;
+    }
+    catch(structopt::exception & e) {
+        println("{}", e.what()); println("{}", e.help());
+    }
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "stdafx.h"
+#include "archive.h"
+#include "zipmount.h"
+
+// built with ZIPMOUNT_LIBRARY defined, which leaves the frontends' globals out of archive.h and prefixes miniz
+#ifndef ZIPMOUNT_LIBRARY
+#error "zipmount_lib.cpp builds with ZIPMOUNT_LIBRARY defined"
+#endif
+
+using namespace zipmount::detail;
+
+// the core plus where each file's data starts, found in its local header on the first read and kept: 0 until then,
+// BROKEN for a header that cannot be read
+struct zipmount::archive::impl : archive_t {
+    enum : uint64_t { BROKEN = ~0ull };
+
+    unique_ptr<atomic<uint64_t>[]> offsets;
+
+    bool has(int node) const { return node >= 0 && (size_t)node < index.nodes.size(); }
+
+    bool is_file(int node) const { return has(node) && index.nodes[node].type == FILE; }
+
+    uint64_t offset_of(int node) {
+        auto r = offsets[node].load(std::memory_order_relaxed); if(!r) {
+            r = data_offset(node); if(!r) r = BROKEN; offsets[node].store(r, std::memory_order_relaxed);
+        }
+
+        return r != BROKEN ? r : 0;
+    }
+};
+
+zipmount::archive::archive() = default;
+
+zipmount::archive::~archive() = default;
+
+zipmount::archive::archive(archive &&) noexcept = default;
+
+zipmount::archive & zipmount::archive::operator=(archive &&) noexcept = default;
+
+bool zipmount::archive::open(string const & fname, options_t const & options) {
+    auto codec = find_if(begin(codecs), end(codecs), [&](auto & c) { return options.codec == c.name; }); auto policy = make_policy(options.policy);
+
+    if(codec == end(codecs) || !policy) return false;
+
+    // the cache is keyed by node, a new archive starts from scratch
+    auto a = make_unique<impl>(); {
+        a->codec = codec; a->cache.set_policy(std::move(policy)); a->cache.set_capacity(options.cache_size);
+    }
+
+    if(!a->open(fname)) return false;
+
+    a->offsets.reset(new atomic<uint64_t>[a->index.nodes.size()] {});
+
+    m_impl = std::move(a); return true;
+}
+
+int zipmount::archive::lookup(string_view fpath) const {
+    if(!m_impl) return -1;
+
+    while(!fpath.empty() && fpath.front() == '/') fpath.remove_prefix(1);
+
+    auto e = m_impl->locate(fpath); return e.type != archive_t::NONE ? e.index : -1;
+}
+
+optional<zipmount::stat_t> zipmount::archive::stat(int node) const {
+    if(!m_impl || !m_impl->has(node)) return {};
+
+    auto st = m_impl->stat(node); return stat_t {st.fpath, st.fname, st.size, st.mtime, st.is_dir()};
+}
+
+span<const uint32_t> zipmount::archive::list(int node) const {
+    if(!m_impl || !m_impl->has(node)) return {};
+
+    auto & n = m_impl->index.nodes[node]; return m_impl->index.children.subspan(n.first_child, n.child_count);
+}
+
+int64_t zipmount::archive::read_at(int node, uint64_t offset, void * dst, size_t n) {
+    if(!m_impl || !m_impl->is_file(node)) return -1;
+
+    auto & a = *m_impl; auto size = a.index.meta.size[node]; if(offset >= size) return 0;
+
+    // stored bytes are copied from the mapping and deflated ones from the cache, decoding only what is missing
+    n = (size_t)std::min<uint64_t>(n, size - offset); return !n || a.read(node, a.offset_of(node), offset, dst, n) ? (int64_t)n : -1;
+}
+
+span<const uint8_t> zipmount::archive::map_span(int node) const {
+    if(!m_impl || !m_impl->is_file(node) || m_impl->index.meta.method[node] != 0) return {};
+
+    auto src = m_impl->offset_of(node); if(!src) return {};
+
+    return {m_impl->data() + src, (size_t)m_impl->index.meta.size[node]};
+}